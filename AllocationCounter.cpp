@@ -0,0 +1,55 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+#ifdef TLD_COUNT_ALLOCATIONS
+
+// Number of calls to operator new so far, from any thread
+static std::atomic<unsigned long> allocationCount(0);
+
+
+void *operator new(size_t size) {
+    allocationCount++;
+    void *p = malloc(size > 0 ? size : 1);
+    
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    
+    return p;
+}
+
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+
+void operator delete(void *p) throw() {
+    free(p);
+}
+
+
+void operator delete[](void *p) throw() {
+    free(p);
+}
+
+
+unsigned long getAllocationCount() {
+    return allocationCount;
+}
+
+#else
+
+unsigned long getAllocationCount() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,21 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+
+
+/*  Debugging aid counting heap allocations. When compiled with
+    TLD_COUNT_ALLOCATIONS defined (e.g. mex -DTLD_COUNT_ALLOCATIONS ...), the
+    global operator new is replaced by one that counts every call, so that
+    the steady-state frame loop can be checked to make no allocations (see
+    tests/testAllocations.cpp).
+    Otherwise the count is always 0 and there is no overhead.
+    
+    Note: only allocations made through operator new are counted; memory
+    allocated by OpenCV or Matlab is not. */
+
+/*  Returns the number of allocations made through operator new since the
+    program started, or 0 if TLD_COUNT_ALLOCATIONS is not defined. */
+unsigned long getAllocationCount(void);
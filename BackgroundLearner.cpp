@@ -0,0 +1,128 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "BackgroundLearner.h"
+#include <string.h>
+
+
+BackgroundLearner::BackgroundLearner(Classifier *classifier, int capacity) {
+    this->classifier = classifier;
+    this->capacity = capacity;
+    fernCount = classifier->getFernCount();
+    queueCodes = new int[capacity * fernCount];
+    queueClasses = new int[capacity];
+    batchCodes = new int[capacity * fernCount];
+    batchClasses = new int[capacity];
+    head = 0;
+    count = 0;
+    learnt = 0;
+    dropped = 0;
+    busy = false;
+    stopping = false;
+    worker = thread(&BackgroundLearner::work, this);
+}
+
+
+void BackgroundLearner::work() {
+    while (true) {
+        int batchSize;
+        
+        // Wait for patches, then take all of them, oldest first
+        {
+            unique_lock<mutex> guard(lock);
+            
+            while (!stopping && count == 0) {
+                wake.wait(guard);
+            }
+            
+            if (stopping) {
+                return;
+            }
+            
+            for (batchSize = 0; batchSize < count; batchSize++) {
+                int slot = (head + batchSize) % capacity;
+                memcpy(batchCodes + batchSize * fernCount, queueCodes + slot * fernCount, fernCount * sizeof(int));
+                batchClasses[batchSize] = queueClasses[slot];
+            }
+            
+            head = (head + count) % capacity;
+            count = 0;
+            busy = true;
+        }
+        
+        // Train and publish without holding the lock, so patches can be
+        // queued meanwhile
+        for (int i = 0; i < batchSize; i++) {
+            classifier->trainFromCodes(batchCodes + i * fernCount, batchClasses[i]);
+        }
+        
+        classifier->publish();
+        
+        // Let flush know once the queue has been emptied
+        {
+            unique_lock<mutex> guard(lock);
+            learnt += batchSize;
+            busy = false;
+            
+            if (count == 0) {
+                idle.notify_all();
+            }
+        }
+    }
+}
+
+
+void BackgroundLearner::enqueue(const int *codes, int patchClass) {
+    unique_lock<mutex> guard(lock);
+    
+    // Drop the oldest patch to make room if the queue is full
+    if (count == capacity) {
+        head = (head + 1) % capacity;
+        count--;
+        dropped++;
+    }
+    
+    int slot = (head + count) % capacity;
+    memcpy(queueCodes + slot * fernCount, codes, fernCount * sizeof(int));
+    queueClasses[slot] = patchClass;
+    count++;
+    wake.notify_one();
+}
+
+
+void BackgroundLearner::flush() {
+    unique_lock<mutex> guard(lock);
+    
+    while (count > 0 || busy) {
+        idle.wait(guard);
+    }
+}
+
+
+unsigned long BackgroundLearner::getLearntCount() {
+    unique_lock<mutex> guard(lock);
+    return learnt;
+}
+
+
+unsigned long BackgroundLearner::getDroppedCount() {
+    unique_lock<mutex> guard(lock);
+    return dropped;
+}
+
+
+BackgroundLearner::~BackgroundLearner() {
+    {
+        unique_lock<mutex> guard(lock);
+        stopping = true;
+    }
+    
+    wake.notify_one();
+    worker.join();
+    delete [] queueCodes;
+    delete [] queueClasses;
+    delete [] batchCodes;
+    delete [] batchClasses;
+}
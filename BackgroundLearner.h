@@ -0,0 +1,101 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "Classifier.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+
+/*  Trains a classifier on a background thread, off the frame processing
+    path.
+    
+    Training patches are queued as their leaf node indices (see
+    Classifier::trainFromCodes), so they don't hold on to the frame they
+    came from. A worker thread takes every queued patch at once, trains on
+    them and publishes the result (see Classifier::publish), so the detector
+    and tracker keep classifying against consistent posteriors meanwhile.
+    
+    The queue has a fixed capacity; when it is full, the oldest patch is
+    dropped to make room, as newer patches better describe the object. All
+    memory is allocated on construction, so queueing never allocates. */
+class BackgroundLearner {
+    // Private ===============================================================
+    private:
+    // Classifier to train, and its number of ferns
+    Classifier *classifier;
+    int fernCount;
+    
+    // Queued patches as a ring buffer: the leaf node indices of each patch,
+    // fernCount per patch, and its class
+    int *queueCodes;
+    int *queueClasses;
+    int capacity;
+    int head;
+    int count;
+    
+    // Patches taken from the queue by the worker, trained on outside the
+    // lock
+    int *batchCodes;
+    int *batchClasses;
+    
+    // Number of patches trained on and dropped from the queue
+    unsigned long learnt;
+    unsigned long dropped;
+    
+    // Guards the queue and the state below and is used with the condition
+    // variables
+    mutex lock;
+    
+    // Signalled when patches are queued or the learner is being destroyed
+    condition_variable wake;
+    
+    // Signalled when the worker has trained on every queued patch
+    condition_variable idle;
+    
+    // Set while the worker is training on a batch
+    bool busy;
+    
+    // Set when the learner is being destroyed
+    bool stopping;
+    
+    // Worker thread
+    thread worker;
+    
+    /*  Main loop of the worker thread. */
+    void work(void);
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor. The classifier MUST NOT be trained or published from any
+        other thread while the learner exists.
+        classifier: classifier to train
+        capacity: maximum number of queued patches */
+    BackgroundLearner(Classifier *classifier, int capacity);
+    
+    /*  Queues a patch to train on, dropping the oldest queued patch if the
+        queue is full. Never waits for training.
+        codes: leaf node index of the patch in each fern (see
+            Classifier::trainFromCodes)
+        patchClass: 0 if the patch is negative, 1 if the patch is positive */
+    void enqueue(const int *codes, int patchClass);
+    
+    /*  Waits until every queued patch has been trained on and published. */
+    void flush(void);
+    
+    /*  Returns the number of patches trained on so far. */
+    unsigned long getLearntCount(void);
+    
+    /*  Returns the number of patches dropped from the full queue so far. */
+    unsigned long getDroppedCount(void);
+    
+    /*  Destructor. Stops and joins the worker, discarding any queued
+        patches. */
+    ~BackgroundLearner(void);
+};
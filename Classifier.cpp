@@ -4,43 +4,29 @@
     Foundation. This software is provided without warranty of ANY kind. */
 
 #include "Classifier.h"
-
-
-Classifier::Classifier(int fernNum, int nodeNum, float minScale, float maxScale) {
-    // Initialise the ferns
-    ferns = new Fern*[fernNum];
-    fernCount = fernNum;
-
-    for (int i = 0; i < fernCount; i++) {
-        ferns[i] = new Fern(nodeNum, minScale, maxScale);
-    }
-}
-
-
-void Classifier::train(IntegralImage *image, int patchX, int patchY, int patchW, int patchH, int patchClass) {
-    // Train all the ferns
-    for (int i = 0; i < fernCount; i++) {
-        ferns[i]->train(image, patchX, patchY, patchW, patchH, patchClass);
-    }
-}
-
-
-float Classifier::classify(IntegralImage *image, int patchX, int patchY, int patchW, int patchH) {
-    // Calcualte the average fern posterior likelihood
-    float sum = 0.0f;
-    
-    for (int i = 0; i < fernCount; i++) {
-        sum += ferns[i]->classify(image, patchX, patchY, patchW, patchH);
+#include "FernClassifier.h"
+#include "HaarTest.h"
+#include "TwoBitBPTest.h"
+#include <stdio.h>
+
+
+Classifier *Classifier::create(int fernNum, int nodeNum, int featureType, float minScale, float maxScale, std::mt19937 &random) {
+    // Pick the matching specialisation. To support other parameters, add
+    // another instantiation here
+    if (featureType == FEATURE_TWO_BIT_BP && fernNum == 10) {
+        switch (nodeNum) {
+            case 4: return new FernClassifier<10, 4, TwoBitBPTest>(minScale, maxScale, random);
+            case 5: return new FernClassifier<10, 5, TwoBitBPTest>(minScale, maxScale, random);
+            case 6: return new FernClassifier<10, 6, TwoBitBPTest>(minScale, maxScale, random);
+        }
     }
-    
-    return sum / fernCount;
-}
-
-
-Classifier::~Classifier() {
-    for (int i = 0; i < fernCount; i++) {
-        delete ferns[i];
+    else if (featureType == FEATURE_HAAR && fernNum == 10) {
+        switch (nodeNum) {
+            case 10: return new FernClassifier<10, 10, HaarTest>(minScale, maxScale, random);
+            case 13: return new FernClassifier<10, 13, HaarTest>(minScale, maxScale, random);
+        }
     }
     
-    delete [] ferns;
+    printf("ERROR: NO CLASSIFIER FOR %d FERNS OF %d NODES OF FEATURE TYPE %d!\n", fernNum, nodeNum, featureType);
+    return NULL;
 }
@@ -4,40 +4,60 @@
     Foundation. This software is provided without warranty of ANY kind. */
 
 #pragma once
-#include "Fern.h"
+#include "Feature.h"
 #include "IntegralImage.h"
 
 
-/*  A random forst classifier. */
-class Classifier {
-    // Private ===============================================================
-    private:
-    // Array of ferns
-    Fern **ferns;
-    
-    // Number of ferns
-    int fernCount;
-    
+// Constants -----------------------------------------------------------------
+// Number of patches classifyBatch processes per fern at a time
+#define CLASSIFIER_BATCH 16
+
+
+/*  A random forst classifier.
     
+    This is the interface used by the rest of the program. The implementation
+    is the FernClassifier template, specialised at compile-time on the number
+    of ferns, the number of nodes per fern and the feature type; create picks
+    the specialisation for the given runtime parameters. Each call through
+    this interface is virtual, so patches should be classified in batches
+    (see classifyBatch) where possible. */
+class Classifier {
     // Public ================================================================
     public:
-    /*  Constructor.
+    /*  Creates a classifier.
+        Returns the classifier, or NULL if there is no specialisation for the
+            given parameters (see Classifier.cpp for those available).
         fernNum: the number of ferns to create
         nodeNum: number of nodes to create in each fern
+        featureType: type of feature used by the nodes, FEATURE_TWO_BIT_BP or
+            FEATURE_HAAR
         minScale: minimum percentage of patch width and height a feature can
             take
         maxScale: maximum percentage of patch width and height a feature can
-            take*/
-    Classifier(int fernNum, int nodeNum, float minScale, float maxScale);
+            take
+        random: random number generator to place the features with, e.g.
+            one seeded per session so sessions don't share random state */
+    static Classifier *create(int fernNum, int nodeNum, int featureType, float minScale, float maxScale, std::mt19937 &random);
     
-    /*  Trains all ferns in the forest with a single training patch.
+    /*  Trains all ferns in the forest with a single training patch. As for
+        all training, patches are classified with the result once published
+        (see publish).
         image: image to take the training patch from
         patchX: patch top-left x-position
         patchX: patch top-left y-position
         patchW: patch width
         patchH: patch height
         patchClass: 0 if the patch is negative, 1 if the patch is positive */
-    void train(IntegralImage *image, int patchX, int patchY, int patchW, int patchH, int patchClass);
+    virtual void train(IntegralImage *image, int patchX, int patchY, int patchW, int patchH, int patchClass) = 0;
+    
+    /*  Trains all ferns in the forest with a single training patch, given
+        the leaf node indices found when it was classified (see
+        classifyBatch), so no features are evaluated. Same as train for the
+        patch otherwise.
+        codes: leaf node index of the patch in each fern, getFernCount()
+            elements
+        patchClass: 0 if the patch is negative, 1 if the patch is positive */
+    virtual void trainFromCodes(const int *codes, int patchClass) = 0;
     
     /*  Classifies a given patch.
         Returns the posterior likelihood that the patch is positive. If the
@@ -47,8 +67,75 @@ class Classifier {
         patchX: patch top-left y-position
         patchW: patch width
         patchH: patch height */
-    float classify(IntegralImage *image, int patchX, int patchY, int patchW, int patchH);
+    virtual float classify(IntegralImage *image, int patchX, int patchY, int patchW, int patchH) = 0;
+    
+    /*  Classifies a patch given the offsets computed by getOffsets for its
+        size. Returns the same value as classify would for the patch.
+        patch: pointer to the integral image element at the patch's top-left
+        offsets: offsets computed by getOffsets */
+    virtual float classify(const int *patch, const int *offsets) = 0;
+    
+    /*  Classifies a batch of patches of the same size, computing the leaf
+        node indices of several patches at once (see Fern::getLeafIndices).
+        Gives exactly the same results as classify for each patch, except
+        for patches rejected early.
+        
+        Early-exit cascade: after each fern, a patch whose score so far plus
+        the greatest possible score of the remaining ferns can't exceed
+        threshold is rejected without evaluating the remaining ferns. Its
+        result is that upper bound, which is <= threshold, rather than its
+        exact posterior likelihood. So exactly the patches whose posterior
+        likelihood is > threshold get a result > threshold, and those get
+        their exact posterior likelihood. Evaluate the most discriminative
+        ferns first (see setFernOrder) to reject patches sooner.
+        
+        frame: image to take the test patches from
+        windows: offsets of the patches' top-left elements in the frame's
+            integral image data, i.e. y * stride + x
+        windowCount: number of patches
+        offsets: offsets computed by getOffsets for the patch size
+        threshold: patches that can't exceed this are rejected early; pass a
+            negative value to classify every patch exactly
+        out: array of windowCount elements to store the posterior
+            likelihoods in
+        codes: NULL, or array of windowCount * getFernCount() elements to
+            store the leaf node index of each patch in each fern in, patch by
+            patch, e.g. for trainFromCodes. Only complete for patches that
+            were not rejected early */
+    virtual void classifyBatch(IntegralImage *frame, const int *windows, int windowCount, const int *offsets, float threshold, float *out, int *codes) = 0;
+    
+    /*  Publishes the training done so far, so that patches are classified
+        with it from now on. Until then they are classified as before the
+        training, so training may run on another thread while classifying,
+        which never waits on training. Training and publishing MUST only be
+        done from one thread at a time. Publishing may wait for
+        classifications started before the previous publish to finish. */
+    virtual void publish(void) = 0;
+    
+    /*  Returns the number of ferns. */
+    virtual int getFernCount(void) = 0;
+    
+    /*  Sets the order the ferns are evaluated in by classify and
+        classifyBatch. The order is the identity by default. Changing it only
+        changes the order the fern posteriors are summed in, so results may
+        differ in the last bits of precision with float posteriors.
+        order: permutation of the fern indices 0 to getFernCount() - 1, most
+            discriminative first */
+    virtual void setFernOrder(const int *order) = 0;
+    
+    /*  Returns the number of offsets computed by getOffsets. */
+    virtual int getOffsetCount(void) = 0;
+    
+    /*  Computes the integral image offsets describing every feature of every
+        fern on a patch of the given size, relative to the patch's top-left
+        element, so patches of that size can be classified with integer table
+        lookups alone.
+        patchW: patch width, limited to the image
+        patchH: patch height, limited to the image
+        stride: stride of the integral image the patch is in
+        offsets: array of getOffsetCount() elements to store the offsets in */
+    virtual void getOffsets(int patchW, int patchH, int stride, int *offsets) = 0;
     
     /*  Destructor. */
-    ~Classifier(void);
+    virtual ~Classifier(void) {}
 };
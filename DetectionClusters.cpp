@@ -0,0 +1,155 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "DetectionClusters.h"
+#include "Detector.h"
+#include <algorithm>
+#include <math.h>
+
+
+/*  Orders detection indices by decreasing confidence, then by increasing
+    index, so the order is fully determined. */
+struct ConfidenceOrder {
+    const double *confidences;
+    
+    ConfidenceOrder(const double *confidences) : confidences(confidences) {}
+    
+    bool operator()(int a, int b) const {
+        if (confidences[a] != confidences[b]) {
+            return confidences[a] > confidences[b];
+        }
+        
+        return a < b;
+    }
+};
+
+
+DetectionClusters::DetectionClusters(int frameWidth, int frameHeight, int capacity) {
+    this->frameWidth = frameWidth;
+    this->frameHeight = frameHeight;
+    this->capacity = capacity;
+    order = new int[capacity];
+    representatives = new int[capacity];
+    memberCounts = new int[capacity];
+    clusterOf = new int[capacity];
+    visited = new int[capacity];
+    count = 0;
+    
+    // Allocate for the smallest cells. A detection touches at most 2x2
+    // cells, as no cell is smaller than a detection
+    cellSize = MIN_CLUSTER_CELL;
+    columns = frameWidth / MIN_CLUSTER_CELL + 1;
+    rows = frameHeight / MIN_CLUSTER_CELL + 1;
+    cellHeads = new int[columns * rows];
+    entryClusters = new int[capacity * 4];
+    entryNext = new int[capacity * 4];
+    entryCount = 0;
+}
+
+
+void DetectionClusters::cluster(DetectionSet *detections, double minOverlap) {
+    int n = detections->size();
+    double *xs = detections->getXs();
+    double *ys = detections->getYs();
+    double *widths = detections->getWidths();
+    double *heights = detections->getHeights();
+    double *confidences = detections->getConfidences();
+    double *overlaps = detections->getOverlaps();
+    count = 0;
+    entryCount = 0;
+    
+    // Make the cells at least as large as the largest detection, so
+    // overlapping detections always share a cell
+    double largest = MIN_CLUSTER_CELL;
+    
+    for (int i = 0; i < n; i++) {
+        largest = std::max(largest, std::max(widths[i], heights[i]));
+    }
+    
+    cellSize = (int)ceil(largest);
+    columns = frameWidth / cellSize + 1;
+    rows = frameHeight / cellSize + 1;
+    
+    for (int i = 0; i < columns * rows; i++) {
+        cellHeads[i] = -1;
+    }
+    
+    // Visit the detections in order of decreasing confidence
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    
+    std::sort(order, order + n, ConfidenceOrder(confidences));
+    
+    for (int i = 0; i < n; i++) {
+        int d = order[i];
+        double bb[4] = {xs[d], ys[d], widths[d], heights[d]};
+        int x0 = std::max(std::min((int)(bb[0] / cellSize), columns - 1), 0);
+        int y0 = std::max(std::min((int)(bb[1] / cellSize), rows - 1), 0);
+        int x1 = std::max(std::min((int)((bb[0] + bb[2]) / cellSize), columns - 1), 0);
+        int y1 = std::max(std::min((int)((bb[1] + bb[3]) / cellSize), rows - 1), 0);
+        
+        // Find the most confident, i.e. lowest index, overlapping cluster
+        // among those touching the detection's cells
+        int best = -1;
+        
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                for (int e = cellHeads[y * columns + x]; e != -1; e = entryNext[e]) {
+                    int c = entryClusters[e];
+                    
+                    if (visited[c] == d || (best != -1 && c > best)) {
+                        continue;
+                    }
+                    
+                    visited[c] = d;
+                    int r = representatives[c];
+                    
+                    if (overlaps[r] != overlaps[d]) {
+                        continue;
+                    }
+                    
+                    double rbb[4] = {xs[r], ys[r], widths[r], heights[r]};
+                    
+                    if (Detector::bbOverlap(bb, rbb) > minOverlap) {
+                        best = c;
+                    }
+                }
+            }
+        }
+        
+        // Join the cluster, or found a new one and enter it in its cells
+        if (best != -1) {
+            memberCounts[best]++;
+            clusterOf[d] = best;
+        } else {
+            int c = count++;
+            representatives[c] = d;
+            memberCounts[c] = 1;
+            clusterOf[d] = c;
+            visited[c] = d;
+            
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    entryClusters[entryCount] = c;
+                    entryNext[entryCount] = cellHeads[y * columns + x];
+                    cellHeads[y * columns + x] = entryCount++;
+                }
+            }
+        }
+    }
+}
+
+
+DetectionClusters::~DetectionClusters() {
+    delete [] order;
+    delete [] representatives;
+    delete [] memberCounts;
+    delete [] clusterOf;
+    delete [] visited;
+    delete [] cellHeads;
+    delete [] entryClusters;
+    delete [] entryNext;
+}
@@ -0,0 +1,110 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "DetectionSet.h"
+
+
+// Constants -----------------------------------------------------------------
+// Minimum size in pixels of the cells of the grid used to find overlapping
+// detections, limiting the number of cells
+#define MIN_CLUSTER_CELL 16
+
+
+/*  Groups the overlapping detections of a DetectionSet into clusters, i.e.
+    non-maximum suppression. Detections are visited in order of decreasing
+    confidence; each joins the most confident cluster whose representative it
+    overlaps (see Detector::bbOverlap) by more than a minimum, or otherwise
+    founds a new cluster and becomes its representative. Only detections with
+    the same overlapping flag are grouped, so clusters can be learnt from as
+    a whole.
+    
+    Representatives are found through a grid of cells at least as large as
+    the largest detection, so each detection is only compared with the
+    representatives in the cells it touches, at most 4. This assumes the
+    detections are of similar size, as those of one call to Detector::detect
+    are (see SCAN_MIN_SCALE and SCAN_MAX_SCALE): representatives don't
+    overlap each other by more than the minimum, so only a bounded number of
+    them fit in a cell, and clustering takes O(n log n) time for n
+    detections, dominated by the sort. Small detections among much larger
+    ones share large cells, and clustering degrades towards O(n^2) time.
+    The clusters are the same either way (see tests/testClusters.cpp).
+    
+    All memory is allocated on construction, so clustering never
+    allocates. */
+class DetectionClusters {
+    // Private ===============================================================
+    private:
+    // Size of the frames, and maximum number of detections
+    int frameWidth, frameHeight;
+    int capacity;
+    
+    // Indices of the detections in order of decreasing confidence
+    int *order;
+    
+    // Index of the representative detection and number of members of each
+    // cluster, in order of decreasing representative confidence
+    int *representatives;
+    int *memberCounts;
+    int count;
+    
+    // Index of the cluster of each detection
+    int *clusterOf;
+    
+    // Grid of cells: size of a cell in pixels, number of cells in each
+    // dimension, and the first entry of each cell (-1 if empty)
+    int cellSize;
+    int columns, rows;
+    int *cellHeads;
+    
+    // Entries of the cells, each a cluster whose representative touches the
+    // cell, and the next entry in the same cell (-1 if none)
+    int *entryClusters;
+    int *entryNext;
+    int entryCount;
+    
+    // Index of the last detection each cluster was compared with, so a
+    // cluster touching several cells is only compared once per detection
+    int *visited;
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        frameWidth: width of the video stream frames
+        frameHeight: height of the video stream frames
+        capacity: maximum number of detections */
+    DetectionClusters(int frameWidth, int frameHeight, int capacity);
+    
+    /*  Clusters the given detections, replacing any previous clusters.
+        detections: detections to cluster
+        minOverlap: a detection joins a cluster if it overlaps the
+            cluster's representative by more than this */
+    void cluster(DetectionSet *detections, double minOverlap);
+    
+    /*  Returns the number of clusters. */
+    inline int size(void) { return count; }
+    
+    /*  Returns the index in the DetectionSet of a cluster's representative,
+        its most confident detection. Cluster 0 holds the most confident
+        detection of all.
+        i: index of the cluster */
+    inline int getRepresentative(int i) { return representatives[i]; }
+    
+    /*  Returns the indices of the representatives of all clusters, in
+        cluster order. */
+    inline const int *getRepresentatives(void) { return representatives; }
+    
+    /*  Returns the number of detections in a cluster.
+        i: index of the cluster */
+    inline int getMemberCount(int i) { return memberCounts[i]; }
+    
+    /*  Returns the index of the cluster of a detection.
+        i: index of the detection in the DetectionSet */
+    inline int getCluster(int i) { return clusterOf[i]; }
+    
+    /*  Destructor. */
+    ~DetectionClusters(void);
+};
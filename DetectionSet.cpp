@@ -0,0 +1,75 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "DetectionSet.h"
+#include <string.h>
+
+
+DetectionSet::DetectionSet(int capacity, int fernCount) {
+    this->capacity = capacity;
+    this->fernCount = fernCount;
+    count = 0;
+    xs = new double[capacity];
+    ys = new double[capacity];
+    widths = new double[capacity];
+    heights = new double[capacity];
+    confidences = new double[capacity];
+    overlaps = new double[capacity];
+    codes = new int[capacity * fernCount];
+}
+
+
+void DetectionSet::clear() {
+    count = 0;
+}
+
+
+void DetectionSet::append(int first, int n) {
+    // Entries already in place need no moving
+    if (first != count) {
+        memmove(xs + count, xs + first, n * sizeof(double));
+        memmove(ys + count, ys + first, n * sizeof(double));
+        memmove(widths + count, widths + first, n * sizeof(double));
+        memmove(heights + count, heights + first, n * sizeof(double));
+        memmove(confidences + count, confidences + first, n * sizeof(double));
+        memmove(overlaps + count, overlaps + first, n * sizeof(double));
+        memmove(codes + count * fernCount, codes + first * fernCount, n * fernCount * sizeof(int));
+    }
+    
+    count += n;
+}
+
+
+void DetectionSet::writeColumns(double *matrix, int rows, int firstRow) {
+    double *columns[6] = {xs, ys, widths, heights, confidences, overlaps};
+    
+    for (int i = 0; i < 6; i++) {
+        memcpy(matrix + i * rows + firstRow, columns[i], count * sizeof(double));
+    }
+}
+
+
+void DetectionSet::writeColumns(double *matrix, int rows, int firstRow, const int *indices, int n) {
+    double *columns[6] = {xs, ys, widths, heights, confidences, overlaps};
+    
+    for (int i = 0; i < 6; i++) {
+        double *out = matrix + i * rows + firstRow;
+        
+        for (int j = 0; j < n; j++) {
+            out[j] = columns[i][indices[j]];
+        }
+    }
+}
+
+
+DetectionSet::~DetectionSet() {
+    delete [] xs;
+    delete [] ys;
+    delete [] widths;
+    delete [] heights;
+    delete [] confidences;
+    delete [] overlaps;
+    delete [] codes;
+}
@@ -0,0 +1,111 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+
+
+/*  The bounding-boxes found by the detector in a frame, stored as a struct of
+    arrays: one contiguous column each for x, y, width, height, confidence and
+    overlapping, and one for the leaf node indices of each bounding-box in
+    each fern of the classifier (see Classifier::trainFromCodes).
+    
+    All memory is allocated on construction for a fixed capacity, and the set
+    is cleared and refilled every frame, so it never allocates afterwards. The
+    columns can be copied straight into a Matlab output matrix, which is
+    stored column by column (see writeColumns).
+    
+    Entries may be written anywhere within the capacity, e.g. by several
+    threads each filling its own range, and then gathered into the set in
+    order with append. */
+class DetectionSet {
+    // Private ===============================================================
+    private:
+    // Number of entries the set has room for, and the number in it
+    int capacity;
+    int count;
+    
+    // Number of leaf node indices per entry
+    int fernCount;
+    
+    // Columns of the set, capacity elements each
+    double *xs;
+    double *ys;
+    double *widths;
+    double *heights;
+    double *confidences;
+    double *overlaps;
+    
+    // Leaf node indices, fernCount per entry, entry by entry
+    int *codes;
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        capacity: maximum number of entries
+        fernCount: number of ferns of the classifier */
+    DetectionSet(int capacity, int fernCount);
+    
+    /*  Empties the set. */
+    void clear(void);
+    
+    /*  Appends the given number of entries, written from the given position,
+        to the set, moving them down to the end of the set if needed.
+        first: position of the first entry; MUST be >= size()
+        n: number of entries */
+    void append(int first, int n);
+    
+    /*  Sets the entry at the given position. The entry only becomes part of
+        the set once appended (see append).
+        i: position of the entry
+        bb: bounding-box [x, y, width, height]
+        confidence: classifier confidence
+        overlapping: 1 if the bounding-box overlaps with the tracked
+            bounding-box, otherwise 0 */
+    inline void set(int i, const double *bb, double confidence, double overlapping) {
+        xs[i] = bb[0];
+        ys[i] = bb[1];
+        widths[i] = bb[2];
+        heights[i] = bb[3];
+        confidences[i] = confidence;
+        overlaps[i] = overlapping;
+    }
+    
+    /*  Copies the set into the given rows of a matrix stored column by
+        column with the columns [x, y, width, height, confidence,
+        overlapping], one block copy per column.
+        matrix: pointer to the matrix
+        rows: number of rows of the matrix
+        firstRow: row to copy the first entry to */
+    void writeColumns(double *matrix, int rows, int firstRow);
+    
+    /*  As writeColumns, but copies only the given entries, in the given
+        order.
+        matrix: pointer to the matrix
+        rows: number of rows of the matrix
+        firstRow: row to copy the first entry to
+        indices: positions of the entries to copy
+        n: number of entries to copy */
+    void writeColumns(double *matrix, int rows, int firstRow, const int *indices, int n);
+    
+    /*  Returns the number of entries in the set. */
+    inline int size(void) { return count; }
+    
+    /*  Getters for the columns. */
+    inline double *getXs(void) { return xs; }
+    inline double *getYs(void) { return ys; }
+    inline double *getWidths(void) { return widths; }
+    inline double *getHeights(void) { return heights; }
+    inline double *getConfidences(void) { return confidences; }
+    inline double *getOverlaps(void) { return overlaps; }
+    
+    /*  Returns the leaf node indices of the entry at the given position,
+        fernCount elements.
+        i: position of the entry */
+    inline int *getCodes(int i) { return codes + i * fernCount; }
+    
+    /*  Destructor. */
+    ~DetectionSet(void);
+};
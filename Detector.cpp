@@ -4,14 +4,36 @@
     Foundation. This software is provided without warranty of ANY kind. */
 
 #include "Detector.h"
+#include <string.h>
 
 
-Detector::Detector(int frameWidth, int frameHeight, double *bb, Classifier *classifier) {
+Detector::Detector(int frameWidth, int frameHeight, double *bb, Classifier *classifier, ThreadPool *threadPool, double minVariance) {
     width = frameWidth;
     height = frameHeight;
     initBBWidth = (float)bb[2];
     initBBHeight = (float)bb[3];
     this->classifier = classifier;
+    this->threadPool = threadPool;
+    fernCount = classifier->getFernCount();
+    gridCache = new ScanningGridCache(width, height, IntegralImage::strideFor(width), classifier);
+    grid = NULL;
+    scanPositions = SCAN_POSITIONS;
+    bandHits = new int[MAX_BANDS];
+    confidences = new float[MAX_WINDOWS];
+    overlaps = new unsigned char[MAX_WINDOWS];
+    windowStages = new unsigned char[MAX_WINDOWS];
+    candidates = new int[MAX_WINDOWS];
+    candidateOffsets = new int[MAX_WINDOWS];
+    keepOverlap = MIN_LEARNING_OVERLAP;
+    this->minVariance = minVariance;
+    varianceFilter = false;
+    focused = false;
+    frameCount = 0;
+    framesSinceSweep = 0;
+    bandSkips = new int[MAX_BANDS];
+    bandVarianceRejects = new int[MAX_BANDS];
+    bandClassifierRejects = new int[MAX_BANDS];
+    stats.windows = stats.skipped = stats.varianceRejected = stats.classifierRejected = stats.accepted = 0;
 }
 
 
@@ -41,7 +63,7 @@ double Detector::bbOverlap(double *bb1, double *bb2) {
 }
 
 
-vector<double *> *Detector::detect(IntegralImage *frame, double *tbb) {
+void Detector::detect(IntegralImage *frame, double *tbb, DetectionSet *detections, bool focus, bool predicted) {
     // Set the width and height that are used as 1 * scale.
     // If tbb is NULL, we are not tracking and use the first-frame
     // bounding-box size, otherwise we use the tracked bounding-box size
@@ -57,88 +79,308 @@ vector<double *> *Detector::detect(IntegralImage *frame, double *tbb) {
         baseHeight = initBBHeight;
     }
     
+    // Clear the bounding-boxes and counts from the previous call
+    detections->clear();
+    stats.windows = stats.skipped = stats.varianceRejected = stats.classifierRejected = stats.accepted = 0;
+    
+    // Bounding-boxes smaller than 40 pixels aren't scanned. Return before
+    // the schedule of focused frames and full sweeps advances, so a sweep
+    // that is due isn't skipped
     if (baseWidth < 40 || baseHeight < 40) {
-        return new vector<double *>();
+        grid = NULL;
+        return;
+    }
+    
+    // Focus on the tracked bounding-box unless a scan of the whole frame is
+    // due
+    focused = focus && tbb != NULL && framesSinceSweep + 1 < FULL_SWEEP_INTERVAL;
+    frameCount++;
+    
+    if (focused) {
+        framesSinceSweep++;
+        roi[0] = tbb[0] - tbb[2] * ROI_MARGIN;
+        roi[1] = tbb[1] - tbb[3] * ROI_MARGIN;
+        roi[2] = tbb[0] + tbb[2] * (1 + ROI_MARGIN);
+        roi[3] = tbb[1] + tbb[3] * (1 + ROI_MARGIN);
+    } else {
+        framesSinceSweep = 0;
     }
     
     // Using the sliding-window approach, find positive matches to our object
-    // Vector of positive patch matches' bounding-boxes
-    vector<double *> *bbs = new vector<double *>();
-    
-    // Minimum and maximum scales for the bounding-box, the number of scale
-    // iterations to make, and the amount to increment scale by each iteration
-    float minScale = 0.5f;
-    float maxScale = 1.5f;
-    int iterationsScale = 6;
-    float scaleInc = (maxScale - minScale) / (iterationsScale - 1);
-    
-    // Loop through a range of bounding-box scales
-    for (float scale = minScale; scale <= maxScale; scale += scaleInc) {
-        int minX = 0;
-        int currentWidth = (int)(scale * baseWidth);
-        int maxX = width - currentWidth;
-        int iterationsX = 30;
-        int incX = (maxX - minX) / (iterationsX - 1);
+    // The grid of windows is reused for as long as the base size, rounded
+    // to the nearest pixel, and the number of positions stay the same
+    grid = gridCache->get((int)(baseWidth + 0.5f), (int)(baseHeight + 0.5f), scanPositions);
+    int bandCount = grid->getBandCount();
+    
+    // Scan the bands, in parallel if we have a thread pool
+    currentFrame = frame;
+    currentTbb = tbb;
+    currentDetections = detections;
+    keepOverlap = predicted ? MIN_PREDICTED_OVERLAP : MIN_LEARNING_OVERLAP;
+    varianceFilter = minVariance > 0 && frame->hasSquares();
+    
+    if (threadPool != NULL) {
+        threadPool->run(this, bandCount);
+    } else {
+        for (int i = 0; i < bandCount; i++) {
+            run(i);
+        }
+    }
+    
+    // Merge the results of each band in order. Each band's accepted windows
+    // are stored from its first window's position in the set
+    for (int i = 0; i < bandCount; i++) {
+        detections->append(grid->getBand(i)->first, bandHits[i]);
+        
+        stats.skipped += bandSkips[i];
+        stats.varianceRejected += bandVarianceRejects[i];
+        stats.classifierRejected += bandClassifierRejects[i];
+        stats.accepted += bandHits[i];
+    }
+    
+    stats.windows = grid->getWindowCount();
+}
+
+
+void Detector::run(int index) {
+    ScanningBand *band = grid->getBand(index);
+    int *xs = grid->getWindowXs() + band->first;
+    int *ys = grid->getWindowYs() + band->first;
+    int *windowOffsets = grid->getWindowOffsets() + band->first;
+    int *offsets = grid->getScaleOffsets(band->scale);
+    int currentWidth = grid->getScaleWidth(band->scale);
+    int currentHeight = grid->getScaleHeight(band->scale);
+    float *p = confidences + band->first;
+    unsigned char *overlapping = overlaps + band->first;
+    int *bandCandidates = candidates + band->first;
+    int *bandCandidateOffsets = candidateOffsets + band->first;
+    int *codes = currentDetections->getCodes(band->first);
+    unsigned char *stage = windowStages + band->first;
+    int hits = 0;
+    
+    // Find the windows to scan. When focusing, a band is scanned where it
+    // lies within the region around the tracked bounding-box, unless it is
+    // one of the rotating subset scanned whole. The windows of a band share
+    // their x-position and are in order of y-position
+    int begin = 0;
+    int end = band->count;
+    
+    if (focused && (index + frameCount) % ROI_SAMPLE_PERIOD != 0) {
+        if (xs[0] < roi[0] || xs[0] + currentWidth > roi[2]) {
+            end = 0;
+        }
         
-        // If bounding-box width >= frame width, make only 1 iteration of the
-        // following for loop
-        if (incX <= 0) {
-            maxX = 0;
-            incX = 1;
+        while (begin < end && ys[begin] < roi[1]) {
+            begin++;
         }
         
-        // Loop through all bounding-box top-left x-positions
-        for (int x = minX; x <= maxX; x += incX) {
-            // Same for y
-            int minY = 0;
-            int currentHeight = (int)(scale * baseHeight);
-            int maxY = height - currentHeight;
-            int iterationsY = 30;
-            int incY = (maxY - minY) / (iterationsY - 1);
+        while (end > begin && ys[end - 1] + currentHeight > roi[3]) {
+            end--;
+        }
+    }
+    
+    for (int i = 0; i < band->count; i++) {
+        stage[i] = i < begin || i >= end ? WINDOW_SKIPPED : WINDOW_VARIANCE_REJECTED;
+    }
+    
+    // Find the windows overlapping with the tracked bounding-box. These are
+    // kept whatever their confidence, so they skip the variance filter and
+    // must be classified exactly. Filter the rest by variance
+    bool overlapFound = false;
+    int candidateCount = 0;
+    
+    // Windows larger than the frame are measured by the variance filter
+    // where they lie within it, just as their features are (see
+    // ScanningGrid::build). Such windows are at the frame's top-left
+    int varianceWidth = std::min(currentWidth, width);
+    int varianceHeight = std::min(currentHeight, height);
+    
+    for (int i = begin; i < end; i++) {
+        overlapping[i] = 0;
+        
+        if (currentTbb != NULL) {
+            double bb[4] = {(double)xs[i], (double)ys[i], (double)currentWidth, (double)currentHeight};
             
-            // If bounding-box height >= frame height, make only 1 iteration
-            // of the following for loop
-            if (incY <= 0) {
-                maxY = 0;
-                incY = 1;
+            if (bbOverlap(bb, currentTbb) > keepOverlap) {
+                overlapping[i] = 1;
+                overlapFound = true;
             }
+        }
+        
+        if (overlapping[i] || !varianceFilter || currentFrame->varianceUnchecked(xs[i], ys[i], varianceWidth, varianceHeight) >= minVariance) {
+            bandCandidates[candidateCount] = i;
+            bandCandidateOffsets[candidateCount] = windowOffsets[i];
+            candidateCount++;
+            stage[i] = WINDOW_CLASSIFIER_REJECTED;
+        }
+    }
+    
+    // Classify all the remaining windows in the band together, rejecting
+    // those that can't be positive early unless the band has windows to
+    // keep anyway
+    float threshold = -1.0f;
+    
+    if (DETECTOR_EARLY_EXIT && !overlapFound) {
+        threshold = DETECTION_THRESHOLD;
+    }
+    
+    classifier->classifyBatch(currentFrame, bandCandidateOffsets, candidateCount, offsets, threshold, p, codes);
+    
+    // Loop through all windows in the band that passed the variance filter
+    for (int j = 0; j < candidateCount; j++) {
+        int i = bandCandidates[j];
+        
+        // If positive, or negative and overlapping with the tracked
+        // bounding-box, keep this bounding-box, storing
+        // [x, y, width, height, confidence, overlapping], where
+        // overlapping is 1 if the bounding-box overlaps with the
+        // tracked bounding box, otherwise 0
+        if (p[j] > DETECTION_THRESHOLD || overlapping[i] == 1) {
+            double bb[4] = {(double)xs[i], (double)ys[i], (double)currentWidth, (double)currentHeight};
+            currentDetections->set(band->first + hits, bb, (double)p[j], (double)overlapping[i]);
             
-            // Loop through all bounding-box top-left x-positions
-            for (int y = minY; y <= maxY; y += incY) {
-                // Classify the patch
-                float p = classifier->classify(frame, x, y, currentWidth, currentHeight);
-                
-                // Store the patch data in an array
-                // [x, y, width, height, confidence, overlapping], where
-                // overlapping is 1 if the bounding-box overlaps with the
-                // tracked bounding box, otherwise 0
-                double *bb = new double[6];
-                bb[0] = (double)x;
-                bb[1] = (double)y;
-                bb[2] = (double)currentWidth;
-                bb[3] = (double)currentHeight;
-                bb[4] = (double)p;
-                
-                if (tbb != NULL && bbOverlap(bb, tbb) > MIN_LEARNING_OVERLAP) {
-                    bb[5] = 1;
-                } else {
-                    bb[5] = 0;
-                }
-                
-                // If positive, or negative and overlapping with the tracked
-                // bounding-box, add this bounding-box to our return list
-                if (p > 0.5f || bb[5] == 1) {
-                    bbs->push_back(bb);
-                } else {
-                    delete [] bb;
-                }
+            // Move the window's leaf codes alongside its bounding-box. Kept
+            // windows have been classified by every fern
+            if (hits != j) {
+                memcpy(codes + hits * fernCount, codes + j * fernCount, fernCount * sizeof(int));
             }
+            
+            stage[i] = WINDOW_KEPT;
+            hits++;
         }
     }
     
-    return bbs;
+    bandHits[index] = hits;
+    bandSkips[index] = band->count - (end - begin);
+    bandVarianceRejects[index] = end - begin - candidateCount;
+    bandClassifierRejects[index] = candidateCount - hits;
+}
+
+
+void Detector::relabel(DetectionSet *detections, double *tbb) {
+    double *xs = detections->getXs();
+    double *ys = detections->getYs();
+    double *widths = detections->getWidths();
+    double *heights = detections->getHeights();
+    double *confs = detections->getConfidences();
+    int count = detections->size();
+    int kept = 0;
+    
+    // Compact the detections to keep in place, then take them back into the
+    // set, which moves nothing
+    detections->clear();
+    
+    for (int i = 0; i < count; i++) {
+        double bb[4] = {xs[i], ys[i], widths[i], heights[i]};
+        double overlapping = tbb != NULL && bbOverlap(bb, tbb) > MIN_LEARNING_OVERLAP ? 1 : 0;
+        
+        if (confs[i] > DETECTION_THRESHOLD || overlapping == 1) {
+            if (kept != i) {
+                memcpy(detections->getCodes(kept), detections->getCodes(i), fernCount * sizeof(int));
+            }
+            
+            detections->set(kept, bb, confs[i], overlapping);
+            kept++;
+        }
+    }
+    
+    detections->append(0, kept);
+    stats.accepted -= count - kept;
+    stats.classifierRejected += count - kept;
+    
+    // Windows overlapping the tracked bounding-box are kept to learn from,
+    // but the scan only kept those overlapping the prediction of it. Where
+    // the prediction was wrong, e.g. as the object accelerated, classify
+    // the windows it missed now
+    if (tbb != NULL && grid != NULL) {
+        recoverOverlapping(detections, tbb);
+    }
+}
+
+
+int Detector::recoverOverlapping(DetectionSet *detections, double *tbb) {
+    int *xs = grid->getWindowXs();
+    int *ys = grid->getWindowYs();
+    int *windowOffsets = grid->getWindowOffsets();
+    int first = detections->size();
+    int recovered = 0;
+    
+    for (int b = 0; b < grid->getBandCount(); b++) {
+        ScanningBand *band = grid->getBand(b);
+        int currentWidth = grid->getScaleWidth(band->scale);
+        int currentHeight = grid->getScaleHeight(band->scale);
+        
+        // The windows of a band share their x-position, so bands clear of
+        // the bounding-box are passed over whole
+        if (xs[band->first] > tbb[0] + tbb[2] || xs[band->first] + currentWidth < tbb[0]) {
+            continue;
+        }
+        
+        // Find the band's windows to classify. The scan is over, so its
+        // scratch space is reused
+        int count = 0;
+        
+        for (int i = band->first; i < band->first + band->count; i++) {
+            double bb[4] = {(double)xs[i], (double)ys[i], (double)currentWidth, (double)currentHeight};
+            
+            if (windowStages[i] != WINDOW_KEPT && bbOverlap(bb, tbb) > MIN_LEARNING_OVERLAP) {
+                candidates[count] = i;
+                candidateOffsets[count] = windowOffsets[i];
+                count++;
+            }
+        }
+        
+        if (count == 0) {
+            continue;
+        }
+        
+        // Classify them exactly, storing their leaf codes straight into the
+        // set, and take them from the stages that rejected them
+        classifier->classifyBatch(currentFrame, candidateOffsets, count, grid->getScaleOffsets(band->scale), -1.0f, confidences, detections->getCodes(first + recovered));
+        
+        for (int j = 0; j < count; j++) {
+            int i = candidates[j];
+            double bb[4] = {(double)xs[i], (double)ys[i], (double)currentWidth, (double)currentHeight};
+            detections->set(first + recovered, bb, (double)confidences[j], 1);
+            
+            if (windowStages[i] == WINDOW_SKIPPED) {
+                stats.skipped--;
+            } else if (windowStages[i] == WINDOW_VARIANCE_REJECTED) {
+                stats.varianceRejected--;
+            } else {
+                stats.classifierRejected--;
+            }
+            
+            windowStages[i] = WINDOW_KEPT;
+            recovered++;
+        }
+    }
+    
+    detections->append(first, recovered);
+    stats.accepted += recovered;
+    return recovered;
+}
+
+
+void Detector::setScanPositions(int positions) {
+    scanPositions = std::max(std::min(positions, SCAN_POSITIONS), 2);
+}
+
+
+DetectorStats Detector::getStats() {
+    return stats;
 }
 
 
 Detector::~Detector() {
+    delete gridCache;
+    delete [] bandHits;
+    delete [] confidences;
+    delete [] overlaps;
+    delete [] windowStages;
+    delete [] candidates;
+    delete [] candidateOffsets;
+    delete [] bandSkips;
+    delete [] bandVarianceRejects;
+    delete [] bandClassifierRejects;
 }
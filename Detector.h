@@ -5,7 +5,9 @@
 
 #pragma once
 #include "Classifier.h"
-#include <vector>
+#include "DetectionSet.h"
+#include "ScanningGrid.h"
+#include "ThreadPool.h"
 
 using namespace std;
 
@@ -15,13 +17,99 @@ using namespace std;
 // counts as an overlap
 #define MIN_LEARNING_OVERLAP 0.6
 
+// Windows with a confidence greater than this are positive
+#define DETECTION_THRESHOLD 0.5f
 
-/*  Object detector implemented using a sliding-window approach. */
-class Detector {
+// When detecting around a predicted bounding-box (see Detector::detect),
+// windows overlapping it by more than this are kept until relabelled with
+// the tracked bounding-box. Lower than MIN_LEARNING_OVERLAP so windows
+// overlapping the tracked bounding-box are still kept when the object moves
+#define MIN_PREDICTED_OVERLAP 0.3
+
+// 1 to reject windows that can't be positive without evaluating every fern
+// (see Classifier::classifyBatch), 0 to classify every window exactly
+#define DETECTOR_EARLY_EXIT 1
+
+// When focusing on the tracked bounding-box (see Detector::detect), the
+// margin around it scanned, as a multiple of its width and height on each
+// side
+#define ROI_MARGIN 1.0
+
+// When focusing, one in this many of the bands outside the margin are
+// scanned, rotating from frame to frame so the whole frame is covered every
+// ROI_SAMPLE_PERIOD frames
+#define ROI_SAMPLE_PERIOD 10
+
+// When focusing, the whole frame is still scanned once every this many
+// frames
+#define FULL_SWEEP_INTERVAL 10
+
+// How each window of a call to detect was handled: not scanned as the
+// detector focused elsewhere, rejected by the variance filter or the
+// classifier, or kept (see Detector::relabel)
+#define WINDOW_SKIPPED 0
+#define WINDOW_VARIANCE_REJECTED 1
+#define WINDOW_CLASSIFIER_REJECTED 2
+#define WINDOW_KEPT 3
+
+/*  Number of windows handled by each stage of the detector's cascade in a
+    call to Detector::detect. */
+struct DetectorStats {
+    // Number of windows in the scanning grid
+    int windows;
+    
+    // Number of windows not scanned as the detector focused on the tracked
+    // bounding-box
+    int skipped;
+    
+    // Number of windows rejected by the variance filter
+    int varianceRejected;
+    
+    // Number of windows rejected by the classifier
+    int classifierRejected;
+    
+    // Number of windows returned, i.e. positive or overlapping with the
+    // tracked bounding-box
+    int accepted;
+};
+
+
+/*  Object detector implemented using a sliding-window approach.
+    
+    The windows are laid out by a ScanningGrid, cached per base
+    bounding-box size, and split into bands (see ScanningBand) which are
+    scanned in parallel on a thread pool. Each band collects its results
+    locally and the results are merged in band order, so the output is
+    identical to that of a serial scan regardless of the number of threads.
+    
+    Windows pass through a cascade of stages, cheapest first:
+        1. Variance filter: windows whose pixel variance is below a minimum,
+           e.g. flat regions of sky or wall, are rejected. Needs frames with
+           squared-sum tables (see IntegralImage::setBuildSquares)
+        2. Classifier: windows that are not positive are rejected, most of
+           them before every fern is evaluated (see
+           Classifier::classifyBatch)
+    Windows overlapping with the tracked bounding-box skip the variance
+    filter and are classified exactly, as they are kept for learning.
+    
+    Detection can run before the tracked bounding-box is known, e.g.
+    concurrently with the tracker, using the previous frame's bounding-box
+    as a prediction of it. Windows loosely overlapping the prediction are
+    then kept, and relabel settles which overlap the tracked bounding-box
+    once it is known, classifying any such windows the scan didn't keep as
+    the prediction was wrong.
+    
+    While the tracker is confident, the detector can focus on the tracked
+    bounding-box: it scans only the windows within ROI_MARGIN of it, plus a
+    rotating subset of the other bands, and falls back to scanning the whole
+    frame every FULL_SWEEP_INTERVAL frames. */
+class Detector : public ParallelTask {
     // Private ===============================================================
     private:
-    // Pointer to the classifier for the entire program
+    // Pointer to the classifier for the entire program, and its number of
+    // ferns
     Classifier *classifier;
+    int fernCount;
     
     // Size of each frame
     int width;
@@ -31,6 +119,77 @@ class Detector {
     float initBBWidth;
     float initBBHeight;
     
+    // Cache of scanning grids, and the grid of the current call to detect
+    ScanningGridCache *gridCache;
+    ScanningGrid *grid;
+    
+    // Number of positions scanned in each dimension (see setScanPositions)
+    int scanPositions;
+    
+    // Number of windows accepted in each band of the current grid
+    int *bandHits;
+    
+    // Confidence of each window of the current grid
+    float *confidences;
+    
+    // 1 for each window of the current grid that overlaps the tracked
+    // bounding-box, otherwise 0
+    unsigned char *overlaps;
+    
+    // How each window of the current grid was handled, WINDOW_SKIPPED to
+    // WINDOW_KEPT
+    unsigned char *windowStages;
+    
+    // Windows of each band that passed the variance filter, from the band's
+    // first window's position: their indices in the band and their offsets
+    int *candidates;
+    int *candidateOffsets;
+    
+    // Minimum overlap with the tracked bounding-box of a window kept in the
+    // current call to detect whatever its confidence
+    double keepOverlap;
+    
+    // Minimum variance of a window to pass the variance filter, and whether
+    // the filter is applied in the current call to detect
+    double minVariance;
+    bool varianceFilter;
+    
+    // Whether the current call to detect focuses on the tracked
+    // bounding-box, and if so the region scanned [x0, y0, x1, y1]
+    bool focused;
+    double roi[4];
+    
+    // Number of calls to detect so far, and the number since the last scan
+    // of the whole frame
+    int frameCount;
+    int framesSinceSweep;
+    
+    // Number of windows skipped by the schedule and rejected by each stage
+    // in each band of the current grid
+    int *bandSkips;
+    int *bandVarianceRejects;
+    int *bandClassifierRejects;
+    
+    // Stage counts of the most recent call to detect
+    DetectorStats stats;
+    
+    // Frame, tracked bounding-box and result set of the current call to
+    // detect
+    IntegralImage *currentFrame;
+    double *currentTbb;
+    DetectionSet *currentDetections;
+    
+    // Thread pool to scan bands on, or NULL to scan on the calling thread
+    ThreadPool *threadPool;
+    
+    /*  Classifies the windows of the current grid that overlap the tracked
+        bounding-box but weren't kept by the scan, and appends them to a
+        set of detections as overlapping.
+        Returns the number of windows appended.
+        detections: set to append to
+        tbb: tracked bounding-box [x, y, width, height] */
+    int recoverOverlapping(DetectionSet *detections, double *tbb);
+    
     
     // Public ================================================================
     public:
@@ -39,17 +198,55 @@ class Detector {
         frameHeight: height of the video stream frames
         bb: array containing the trajectory bounding-box
             [x, y, width, height]
-        classifier: pointer to the classifier for the program */
-    Detector(int frameWidth, int frameHeight, double *bb, Classifier *classifier);
+        classifier: pointer to the classifier for the program
+        threadPool: thread pool to scan on, or NULL to scan on the calling
+            thread
+        minVariance: windows with a lower pixel variance are rejected; 0 to
+            disable the variance filter */
+    Detector(int frameWidth, int frameHeight, double *bb, Classifier *classifier, ThreadPool *threadPool, double minVariance);
     
     /*  Detects the object in the given frame.
-        Returns a pointer to a vector of bounding-box arrays each
-            containing [x, y, width, height, confidence, overlapping] that
-            are either positive, or negative and overlapping with the
-            trajectory bounding-box.
         frame: current frame as an IntegralImage; this is NOT freed
-        tbb: tracked bounding-box this frame [x, y, width, height] */
-    vector<double *> *detect(IntegralImage *frame, double *tbb);
+        tbb: tracked bounding-box this frame [x, y, width, height]
+        detections: set to store the bounding-boxes that are either
+            positive, or negative and overlapping with the trajectory
+            bounding-box in, along with their confidences and leaf node
+            indices; it is cleared first. Its capacity MUST be at least
+            MAX_WINDOWS
+        focus: true to scan only around tbb if it isn't NULL and a scan of
+            the whole frame isn't due, false to scan the whole frame
+        predicted: true if tbb is only a prediction of the tracked
+            bounding-box, e.g. the previous frame's; relabel MUST then be
+            called with the tracked bounding-box before the detections are
+            used */
+    void detect(IntegralImage *frame, double *tbb, DetectionSet *detections, bool focus, bool predicted);
+    
+    /*  Completes a call to detect made with a predicted bounding-box, given
+        the tracked bounding-box: sets the overlapping flag of each detection
+        and removes the negative detections that don't overlap it. Windows
+        overlapping it that the scan didn't keep, as they didn't overlap the
+        prediction, are classified and added, so no window to learn from is
+        lost when the prediction was wrong.
+        detections: set filled by detect
+        tbb: tracked bounding-box this frame [x, y, width, height], or NULL
+            if the object wasn't tracked */
+    void relabel(DetectionSet *detections, double *tbb);
+    
+    /*  Sets the number of positions scanned in each dimension by subsequent
+        calls to detect, e.g. SPARSE_SCAN_POSITIONS to scan fewer windows
+        when time is short. Defaults to SCAN_POSITIONS.
+        positions: number of positions, from 2 to SCAN_POSITIONS */
+    void setScanPositions(int positions);
+    
+    /*  Scans one band of the current call to detect. Called by the thread
+        pool; not for use elsewhere.
+        index: index of the band */
+    void run(int index);
+    
+    
+    /*  Returns the number of windows handled by each stage in the most
+        recent call to detect. */
+    DetectorStats getStats(void);
     
     /*  Returns the intersection between two bounding boxes as a percentage of
         their total area.
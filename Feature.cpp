@@ -6,22 +6,31 @@
 #include "Feature.h"
 
 
-Feature::Feature(float minScale, float maxScale) {
+Feature::Feature(float minScale, float maxScale, std::mt19937 &random) {
     // Generate random scales between minScale and maxScale
-    wp = (maxScale - minScale) * ((float)rand() / (float)RAND_MAX) + minScale;
-    hp = (maxScale - minScale) * ((float)rand() / (float)RAND_MAX) + minScale;
+    wp = (maxScale - minScale) * ((float)random() / (float)random.max()) + minScale;
+    hp = (maxScale - minScale) * ((float)random() / (float)random.max()) + minScale;
     
     // Generate random position between 0 and width/height
-    xp = (1.0f - wp) * ((float)rand() / (float)RAND_MAX);
-    yp = (1.0f - hp) * ((float)rand() / (float)RAND_MAX);
+    xp = (1.0f - wp) * ((float)random() / (float)random.max());
+    yp = (1.0f - hp) * ((float)random() / (float)random.max());
 }
 
 
-int Feature::test(IntegralImage *image, int patchX, int patchY, int patchW, int patchH) {
+int Feature::test(const IntegralImageView &image, int patchX, int patchY, int patchW, int patchH) {
     printf("ERROR: FEATURE SUPERCLASS NOT USED CORRECTLY!\n");
     return 0;
 }
 
 
+void Feature::getOffsets(int patchW, int patchH, int stride, int *offsets) {
+    (void)patchW;
+    (void)patchH;
+    (void)stride;
+    (void)offsets;
+    printf("ERROR: FEATURE SUPERCLASS NOT USED CORRECTLY!\n");
+}
+
+
 Feature::~Feature() {
 }
@@ -5,21 +5,33 @@
 
 #pragma once
 #include "IntegralImage.h"
+#include <random>
 
 
 // Constants -----------------------------------------------------------------
-// In order to be able to concatenate numbers to indicate a leaf node in
-// the classifier, each feature must return a range of values that is a
-// power of 2. This is that power (i.e. 2 ^ POWER is the number of different
-// possible return values). MUST be set correctly for the feature used.
-#define POWER 2
+// Feature types available to Classifier::create
+#define FEATURE_TWO_BIT_BP 0
+#define FEATURE_HAAR 1
+
+// Number of integral image offsets describing a feature on a patch of a
+// given size (see getOffsets). Features are evaluated on the 3x3 lattice of
+// points at x, x + w, x + 2w and y, y + h, y + 2h for some test rectangle
+// (x, y, w, h), stored row by row
+#define FEATURE_OFFSETS 9
 
 
 /*  A superclass for the following feature classes:
-        HaarTest: set POWER to 1 if using this
-        TwoBitBPTest: set POWER to 2 if using this
+        HaarTest
+        TwoBitBPTest
     
-    The single chosen subclass is used in the Fern class. */
+    The chosen subclass is a template parameter of Fern and FernClassifier,
+    so features are called with static dispatch. In order to be able to
+    concatenate numbers to indicate a leaf node in the classifier, each
+    feature must return a range of values that is a power of 2. Each
+    subclass MUST define this power as the static constant POWER (i.e.
+    2 ^ POWER is the number of different possible return values), and MUST
+    implement the methods below along with the static methods testOffsets
+    and, when TLD_AVX2 is defined, testOffsets8 (see TwoBitBPTest). */
 class Feature {
     // Protected =============================================================
     protected:
@@ -32,21 +44,36 @@ class Feature {
     
     // Public ================================================================
     public:
+    /*  Constructor. Leaves the feature uninitialised; assign a feature
+        created with the constructor below before use. */
+    Feature(void) {}
+    
     /*  Constructor.
     minScale: minimum percentage of the patch width and height the feature
         can take
     maxScale: maximum percentage of the patch width and height the feature
-        can take */
-    Feature(float minScale, float maxScale);
+        can take
+    random: random number generator to place the feature with */
+    Feature(float minScale, float maxScale, std::mt19937 &random);
     
     /*  Tests the input patch using the feature. MUST be implemented.
         Returns the result of the feature.
-        image: image to take patch from
+        image: view of the image to take patch from
         patchX: patch top-left x-position
         patchX: patch top-left y-position
         patchW: patch width
         patchH: patch height */
-    int test(IntegralImage *image, int patchX, int patchY, int patchW, int patchH);
+    int test(const IntegralImageView &image, int patchX, int patchY, int patchW, int patchH);
+    
+    /*  Computes the integral image offsets of the FEATURE_OFFSETS points
+        describing this feature on a patch of the given size, relative to the
+        patch's top-left element. MUST be implemented.
+        The patch size must already be limited to the image as in test.
+        patchW: patch width
+        patchH: patch height
+        stride: stride of the integral image the patch is in
+        offsets: array of FEATURE_OFFSETS elements to store the offsets in */
+    void getOffsets(int patchW, int patchH, int stride, int *offsets);
     
     /*  Destructor. */
     ~Feature();
@@ -7,53 +7,71 @@
 #include "Feature.h"
 #include "HaarTest.h"
 #include "IntegralImage.h"
+#include "Posterior.h"
+#include "Simd.h"
 #include "TwoBitBPTest.h"
 #include <algorithm>
 #include <math.h>
 
 
-/*  Implementation of a random fern. */
+/*  Implementation of a random fern.
+    
+    The number of nodes and the feature type (see Feature) are template
+    parameters, so the nodes are stored inline in the fern, the features are
+    called with static dispatch and the loops over the nodes have constant
+    trip counts, which the compiler unrolls.
+    
+    The fern's training counts and posteriors are stored in arenas shared by
+    all ferns of a classifier (see FernClassifier), so the fern doesn't own
+    them. The fern only computes leaf node indices and trains; patches are
+    classified against published copies of the posteriors (see
+    FernClassifier::publish). */
+template <int Nodes, class FeatureT>
 class Fern {
+    // Public ================================================================
+    public:
+    // Number of leaf nodes
+    static const int LEAVES = 1 << (Nodes * FeatureT::POWER);
+    
+    // Number of offsets computed by getOffsets
+    static const int OFFSETS = Nodes * FEATURE_OFFSETS;
+    
+    
     // Private ===============================================================
     private:
     // Array of nodes
-    TwoBitBPTest **nodes;
+    FeatureT nodes[Nodes];
     
-    // Number of nodes
-    int nodeCount;
-    
-    // Array containing the number of positive patches that fell into each
-    // leaf node
-    int *p;
-    
-    // Array containing the number of negative patches that fell into each
-    // leaf node
-    int *n;
+    // Array containing the number of positive and negative patches that fell
+    // into each leaf node, at 2 * leaf and 2 * leaf + 1 respectively. Only
+    // used during training
+    int *counts;
     
     // Array containing the precomputed posterior likelihoods that each leaf
-    // node is positive. Values are computed during training so that this
-    // isn't required during classification
-    float *posteriors;
+    // node is positive (see Posterior.h). Values are computed during training
+    // so that this isn't required during classification
+    Posterior *posteriors;
     
-    /*  Computes the index of the leaf node a patch falls into.
-        Returns the index.
-        image: image to take patch from
-        patchX: patch top-left x-position
-        patchX: patch top-left y-position
-        patchW: patch width
-        patchH: patch height */
-    int getLeafIndex(IntegralImage *image, int patchX, int patchY, int patchW, int patchH);
+    // Greatest posterior of any leaf node, used to bound the contribution of
+    // the fern before it is evaluated (see FernClassifier::classifyBatch)
+    Posterior maxPosterior;
     
     
     // Public ================================================================
     public:
-    /*  Constructor.
-        nodeNum: number of nodes to create
+    /*  Constructor. Creates an empty fern; call init before use. Ferns are
+        created in arrays, so they can't take arguments. */
+    Fern(void);
+    
+    /*  Initialises the fern with random features.
         minScale: minimum percentage of patch width and height a feature can
             take
         maxScale: maximum percentage of patch width and height a feature can
-            take */
-    Fern(int nodeNum, float minScale, float maxScale);
+            take
+        random: random number generator to place the features with
+        counts: array of 2 * LEAVES elements to store the training counts in
+        posteriors: array of LEAVES elements to store the posteriors in */
+    void init(float minScale, float maxScale, std::mt19937 &random, int *counts, Posterior *posteriors);
     
     /*  Trains this fern with a single training patch.
         image: image to take the training patch from
@@ -64,15 +82,191 @@ class Fern {
         patchClass: 0 if the patch is negative, 1 if the patch is positive */
     void train(IntegralImage *image, int patchX, int patchY, int patchW, int patchH, int patchClass);
     
-    /*  Classifies a given patch.
-        Returns the posterior liklihood that the patch is positive.
-        image: image to take the test patch from
+    /*  Trains this fern with a single training patch, given the index of the
+        leaf node it falls into, e.g. as found when it was classified.
+        leaf: leaf node index
+        patchClass: 0 if the patch is negative, 1 if the patch is positive */
+    void trainLeaf(int leaf, int patchClass);
+    
+    /*  Computes the index of the leaf node a patch falls into.
+        Returns the index.
+        image: image to take patch from
         patchX: patch top-left x-position
         patchX: patch top-left y-position
         patchW: patch width
         patchH: patch height */
-    float classify(IntegralImage *image, int patchX, int patchY, int patchW, int patchH);
+    int getLeafIndex(IntegralImage *image, int patchX, int patchY, int patchW, int patchH);
+    
+    /*  Computes the index of the leaf node a patch falls into given the
+        offsets computed by getOffsets for its size. This involves only
+        integer table lookups, so it is much cheaper than the above for many
+        patches of the same size.
+        Returns the index.
+        patch: pointer to the integral image element at the patch's top-left
+        offsets: offsets computed by getOffsets */
+    inline int getLeafIndex(const int *patch, const int *offsets) {
+        int leaf = 0;
+        
+        for (int i = 0; i < Nodes; i++) {
+            leaf = leaf | (FeatureT::testOffsets(patch, offsets + i * FEATURE_OFFSETS) << i * FeatureT::POWER);
+        }
+        
+        return leaf;
+    }
+    
+    /*  Computes the leaf node indices of a batch of patches of the same size
+        at once, using AVX2 gathers to process 8 patches at a time where
+        available. Gives the same indices as getLeafIndex.
+        origin: pointer to the integral image element (0, 0)
+        patches: offsets of the patches' top-left elements from origin
+        patchCount: number of patches
+        offsets: offsets computed by getOffsets for the patch size
+        leaves: array of patchCount elements to store the indices in */
+    void getLeafIndices(const int *origin, const int *patches, int patchCount, const int *offsets, int *leaves);
     
-    /*  Destructor. */
-    ~Fern(void);
+    /*  Returns the greatest posterior likelihood of any leaf node, as stored,
+        i.e. the most this fern can contribute to a patch's score. */
+    inline Posterior getMaxPosterior(void) {
+        return maxPosterior;
+    }
+    
+    /*  Computes the integral image offsets describing every node of this fern
+        on a patch of the given size.
+        patchW: patch width, limited to the image
+        patchH: patch height, limited to the image
+        stride: stride of the integral image the patch is in
+        offsets: array of OFFSETS elements to store the offsets in */
+    void getOffsets(int patchW, int patchH, int stride, int *offsets);
 };
+
+
+template <int Nodes, class FeatureT>
+Fern<Nodes, FeatureT>::Fern() {
+    counts = NULL;
+    posteriors = NULL;
+    maxPosterior = posteriorFromLikelihood(0.0f);
+}
+
+
+template <int Nodes, class FeatureT>
+void Fern<Nodes, FeatureT>::init(float minScale, float maxScale, std::mt19937 &random, int *counts, Posterior *posteriors) {
+    this->counts = counts;
+    this->posteriors = posteriors;
+    
+    // Initialise the features
+    for (int i = 0; i < Nodes; i++) {
+        nodes[i] = FeatureT(minScale, maxScale, random);
+    }
+    
+    // Initialise counts and posteriors
+    for (int i = 0; i < LEAVES; i++) {
+        counts[2 * i] = counts[2 * i + 1] = 0;
+        posteriors[i] = posteriorFromLikelihood(0.0f);
+    }
+    
+    maxPosterior = posteriorFromLikelihood(0.0f);
+}
+
+
+template <int Nodes, class FeatureT>
+int Fern<Nodes, FeatureT>::getLeafIndex(IntegralImage *image, int patchX, int patchY, int patchW, int patchH) {
+    // Limit patch to image area
+    int width = image->getWidth();
+    int height = image->getHeight();
+    
+    // Clamp x and y values between 0 and width and height respectively
+    patchX = std::max(std::min(patchX, width - 2), 0);
+    patchY = std::max(std::min(patchY, height - 2), 0);
+    
+    // Limit width and height values to between 0 and (width - patchX) and
+    // (height - patchY) respectively. The features rely on this to skip
+    // bounds checking
+    patchW = std::max(std::min(patchW, width - patchX), 0);
+    patchH = std::max(std::min(patchH, height - patchY), 0);
+    
+    // Apply all tests to find the leaf index this patch falls into
+    IntegralImageView frame = image->view();
+    int leaf = 0;
+    
+    for (int i = 0; i < Nodes; i++) {
+        leaf = leaf | (nodes[i].test(frame, patchX, patchY, patchW, patchH) << i * FeatureT::POWER);
+    }
+    
+    return leaf;
+}
+
+
+template <int Nodes, class FeatureT>
+void Fern<Nodes, FeatureT>::getLeafIndices(const int *origin, const int *patches, int patchCount, const int *offsets, int *leaves) {
+    int i = 0;
+    
+#ifdef TLD_AVX2
+    for (; i + 8 <= patchCount; i += 8) {
+        __m256i windows = _mm256_loadu_si256((const __m256i *)(patches + i));
+        __m256i leaf = _mm256_setzero_si256();
+        
+        for (int j = 0; j < Nodes; j++) {
+            __m256i result = FeatureT::testOffsets8(origin, windows, offsets + j * FEATURE_OFFSETS);
+            leaf = _mm256_or_si256(leaf, _mm256_sll_epi32(result, _mm_cvtsi32_si128(j * FeatureT::POWER)));
+        }
+        
+        _mm256_storeu_si256((__m256i *)(leaves + i), leaf);
+    }
+#endif
+    
+    // Scalar path for the remaining patches
+    for (; i < patchCount; i++) {
+        leaves[i] = getLeafIndex(origin + patches[i], offsets);
+    }
+}
+
+
+template <int Nodes, class FeatureT>
+void Fern<Nodes, FeatureT>::getOffsets(int patchW, int patchH, int stride, int *offsets) {
+    for (int i = 0; i < Nodes; i++) {
+        nodes[i].getOffsets(patchW, patchH, stride, offsets + i * FEATURE_OFFSETS);
+    }
+}
+
+
+template <int Nodes, class FeatureT>
+void Fern<Nodes, FeatureT>::train(IntegralImage *image, int patchX, int patchY, int patchW, int patchH, int patchClass) {
+    // Apply all tests to find the leaf index this patch falls into
+    trainLeaf(getLeafIndex(image, patchX, patchY, patchW, patchH), patchClass);
+}
+
+
+template <int Nodes, class FeatureT>
+void Fern<Nodes, FeatureT>::trainLeaf(int leaf, int patchClass) {
+    // Increment the number of positive or negative patches that fell into
+    // this leaf
+    int *p = counts + 2 * leaf;
+    int *n = p + 1;
+    
+    if (patchClass == 0) {
+        (*n)++;
+    }
+    else {
+        (*p)++;
+    }
+    
+    // Compute the posterior likelihood of a positive class for this leaf
+    if (*p > 0) {
+        Posterior previous = posteriors[leaf];
+        posteriors[leaf] = posteriorFromLikelihood((float)*p / (float)(*p + *n));
+        
+        // Keep the greatest posterior up to date. It only needs recomputing
+        // when the leaf that held it has dropped
+        if (posteriors[leaf] > maxPosterior) {
+            maxPosterior = posteriors[leaf];
+        }
+        else if (previous == maxPosterior && posteriors[leaf] < previous) {
+            maxPosterior = posteriors[0];
+            
+            for (int i = 1; i < LEAVES; i++) {
+                maxPosterior = std::max(maxPosterior, posteriors[i]);
+            }
+        }
+    }
+}
+
@@ -0,0 +1,334 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "Classifier.h"
+#include "Fern.h"
+#include "IntegralImage.h"
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+
+/*  A random forest classifier specialised at compile-time on the number of
+    ferns, the number of nodes per fern and the feature type (see Feature).
+    
+    The ferns, and so all of their features, are stored inline in one flat
+    array, and every loop over ferns and nodes has a constant trip count.
+    The posteriors of all ferns are stored in one contiguous arena, fern by
+    fern, so classifying a patch reads a single small table rather than one
+    heap block per fern. The training counts are kept in a separate arena so
+    they don't share cache lines with the read-mostly posteriors. See
+    Posterior.h for the optional fixed-point posteriors.
+    
+    Training updates the posteriors in place, but patches are classified
+    against one of two published copies of them, so training can run on
+    another thread to classification (see publish). A classification pins
+    the copy it reads with a counter and never waits; publishing fills the
+    other copy once no classification still reads it, then swaps them.
+    
+    Use Classifier::create rather than instantiating this directly. */
+template <int Ferns, int Nodes, class FeatureT>
+class FernClassifier : public Classifier {
+    // Private ===============================================================
+    private:
+    // Array of ferns
+    Fern<Nodes, FeatureT> ferns[Ferns];
+    
+    // Training counts of every fern, Fern::LEAVES * 2 per fern
+    int *counts;
+    
+    // Posteriors of every fern, Fern::LEAVES per fern, as trained
+    Posterior *posteriors;
+    
+    // Published copies of the posteriors and of the greatest posterior of
+    // each fern. The copy index current is classified against
+    Posterior *published[2];
+    Posterior publishedMaxima[2][Ferns];
+    std::atomic<int> current;
+    
+    // Number of classifications reading each published copy
+    std::atomic<int> readers[2];
+    
+    // Indices of the ferns in the order they are evaluated in
+    int order[Ferns];
+    
+    /*  Pins the published copy of the posteriors to classify against, so it
+        isn't overwritten until released. Never waits.
+        Returns the index of the copy. */
+    inline int acquire(void) {
+        for (;;) {
+            int index = current.load();
+            readers[index]++;
+            
+            // If a publish swapped the copies before we pinned ours, ours may
+            // be being overwritten, so try again
+            if (current.load() == index) {
+                return index;
+            }
+            
+            readers[index]--;
+        }
+    }
+    
+    /*  Releases a published copy pinned by acquire.
+        index: index of the copy */
+    inline void release(int index) {
+        readers[index]--;
+    }
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        minScale: minimum percentage of patch width and height a feature can
+            take
+        maxScale: maximum percentage of patch width and height a feature can
+            take
+        random: random number generator to place the features with */
+    FernClassifier(float minScale, float maxScale, std::mt19937 &random);
+    
+    /*  See Classifier. */
+    virtual void train(IntegralImage *image, int patchX, int patchY, int patchW, int patchH, int patchClass);
+    virtual void trainFromCodes(const int *codes, int patchClass);
+    virtual float classify(IntegralImage *image, int patchX, int patchY, int patchW, int patchH);
+    virtual float classify(const int *patch, const int *offsets);
+    virtual void classifyBatch(IntegralImage *frame, const int *windows, int windowCount, const int *offsets, float threshold, float *out, int *codes);
+    virtual void publish(void);
+    virtual int getFernCount(void);
+    virtual void setFernOrder(const int *order);
+    virtual int getOffsetCount(void);
+    virtual void getOffsets(int patchW, int patchH, int stride, int *offsets);
+    
+    /*  Destructor. */
+    virtual ~FernClassifier(void);
+};
+
+
+template <int Ferns, int Nodes, class FeatureT>
+FernClassifier<Ferns, Nodes, FeatureT>::FernClassifier(float minScale, float maxScale, std::mt19937 &random) {
+    const int leaves = Fern<Nodes, FeatureT>::LEAVES;
+    counts = new int[Ferns * leaves * 2];
+    posteriors = new Posterior[Ferns * leaves];
+    published[0] = new Posterior[Ferns * leaves];
+    published[1] = new Posterior[Ferns * leaves];
+    current = 0;
+    readers[0] = 0;
+    readers[1] = 0;
+    
+    // Initialise the ferns
+    for (int i = 0; i < Ferns; i++) {
+        ferns[i].init(minScale, maxScale, random, counts + i * leaves * 2, posteriors + i * leaves);
+        order[i] = i;
+    }
+    
+    // Publish the untrained posteriors to both copies
+    publish();
+    publish();
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+void FernClassifier<Ferns, Nodes, FeatureT>::train(IntegralImage *image, int patchX, int patchY, int patchW, int patchH, int patchClass) {
+    // Train all the ferns
+    for (int i = 0; i < Ferns; i++) {
+        ferns[i].train(image, patchX, patchY, patchW, patchH, patchClass);
+    }
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+void FernClassifier<Ferns, Nodes, FeatureT>::trainFromCodes(const int *codes, int patchClass) {
+    for (int i = 0; i < Ferns; i++) {
+        ferns[i].trainLeaf(codes[i], patchClass);
+    }
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+float FernClassifier<Ferns, Nodes, FeatureT>::classify(IntegralImage *image, int patchX, int patchY, int patchW, int patchH) {
+    // Calcualte the average fern posterior likelihood
+    int index = acquire();
+    const Posterior *table = published[index];
+    PosteriorSum sum = 0;
+    
+    for (int i = 0; i < Ferns; i++) {
+        int leaf = ferns[order[i]].getLeafIndex(image, patchX, patchY, patchW, patchH);
+        sum += table[order[i] * Fern<Nodes, FeatureT>::LEAVES + leaf];
+    }
+    
+    release(index);
+    return posteriorMean(sum, Ferns);
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+float FernClassifier<Ferns, Nodes, FeatureT>::classify(const int *patch, const int *offsets) {
+    // Calcualte the average fern posterior likelihood
+    int index = acquire();
+    const Posterior *table = published[index];
+    PosteriorSum sum = 0;
+    
+    for (int i = 0; i < Ferns; i++) {
+        int leaf = ferns[order[i]].getLeafIndex(patch, offsets + order[i] * Fern<Nodes, FeatureT>::OFFSETS);
+        sum += table[order[i] * Fern<Nodes, FeatureT>::LEAVES + leaf];
+    }
+    
+    release(index);
+    return posteriorMean(sum, Ferns);
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+void FernClassifier<Ferns, Nodes, FeatureT>::classifyBatch(IntegralImage *frame, const int *windows, int windowCount, const int *offsets, float threshold, float *out, int *codes) {
+    const int *origin = frame->view().getOrigin();
+    int leaves[CLASSIFIER_BATCH];
+    PosteriorSum sums[CLASSIFIER_BATCH];
+    
+    // Patches of the current batch still being evaluated: their indices in
+    // the batch and their offsets. Rejected patches are removed, so later
+    // ferns only evaluate the remaining ones
+    int active[CLASSIFIER_BATCH];
+    int activeWindows[CLASSIFIER_BATCH];
+    
+    // Classify the whole batch against the same posteriors
+    int index = acquire();
+    const Posterior *maxima = publishedMaxima[index];
+    
+    for (int first = 0; first < windowCount; first += CLASSIFIER_BATCH) {
+        int count = std::min(CLASSIFIER_BATCH, windowCount - first);
+        
+        for (int j = 0; j < count; j++) {
+            sums[j] = 0;
+            active[j] = j;
+            activeWindows[j] = windows[first + j];
+        }
+        
+        // Sum the fern posteriors in the same order as classify so the
+        // results are bit-exact
+        for (int i = 0; i < Ferns && count > 0; i++) {
+            const Posterior *table = published[index] + order[i] * Fern<Nodes, FeatureT>::LEAVES;
+            ferns[order[i]].getLeafIndices(origin, activeWindows, count, offsets + order[i] * Fern<Nodes, FeatureT>::OFFSETS, leaves);
+            
+            for (int j = 0; j < count; j++) {
+                sums[j] += table[leaves[j]];
+            }
+            
+            if (codes != NULL) {
+                for (int j = 0; j < count; j++) {
+                    codes[(first + active[j]) * Ferns + order[i]] = leaves[j];
+                }
+            }
+            
+            if (threshold < 0.0f || i == Ferns - 1) {
+                continue;
+            }
+            
+            // Reject the patches that can't exceed the threshold. The bound
+            // adds the greatest posteriors of the remaining ferns in the
+            // order their posteriors would be added, so it is never below
+            // the final sum, even with float rounding
+            int remaining = 0;
+            
+            for (int j = 0; j < count; j++) {
+                PosteriorSum bound = sums[j];
+                
+                for (int k = i + 1; k < Ferns; k++) {
+                    bound += maxima[order[k]];
+                }
+                
+                float maxConfidence = posteriorMean(bound, Ferns);
+                
+                if (maxConfidence <= threshold) {
+                    out[first + active[j]] = maxConfidence;
+                } else {
+                    active[remaining] = active[j];
+                    activeWindows[remaining] = activeWindows[j];
+                    sums[remaining] = sums[j];
+                    remaining++;
+                }
+            }
+            
+            count = remaining;
+        }
+        
+        for (int j = 0; j < count; j++) {
+            out[first + active[j]] = posteriorMean(sums[j], Ferns);
+        }
+    }
+    
+    release(index);
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+void FernClassifier<Ferns, Nodes, FeatureT>::publish() {
+    int back = 1 - current.load();
+    
+    // Wait for any classification still reading the other copy from before
+    // the last publish
+    while (readers[back].load() != 0) {
+        std::this_thread::yield();
+    }
+    
+    memcpy(published[back], posteriors, Ferns * Fern<Nodes, FeatureT>::LEAVES * sizeof(Posterior));
+    
+    for (int i = 0; i < Ferns; i++) {
+        publishedMaxima[back][i] = ferns[i].getMaxPosterior();
+    }
+    
+    current.store(back);
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+int FernClassifier<Ferns, Nodes, FeatureT>::getFernCount() {
+    return Ferns;
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+void FernClassifier<Ferns, Nodes, FeatureT>::setFernOrder(const int *order) {
+    // Check the order is a permutation of the fern indices
+    bool seen[Ferns] = {false};
+    
+    for (int i = 0; i < Ferns; i++) {
+        if (order[i] < 0 || order[i] >= Ferns || seen[order[i]]) {
+            printf("ERROR: FERN ORDER IS NOT A PERMUTATION!\n");
+            return;
+        }
+        
+        seen[order[i]] = true;
+    }
+    
+    for (int i = 0; i < Ferns; i++) {
+        this->order[i] = order[i];
+    }
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+int FernClassifier<Ferns, Nodes, FeatureT>::getOffsetCount() {
+    return Ferns * Fern<Nodes, FeatureT>::OFFSETS;
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+void FernClassifier<Ferns, Nodes, FeatureT>::getOffsets(int patchW, int patchH, int stride, int *offsets) {
+    for (int i = 0; i < Ferns; i++) {
+        ferns[i].getOffsets(patchW, patchH, stride, offsets + i * Fern<Nodes, FeatureT>::OFFSETS);
+    }
+}
+
+
+template <int Ferns, int Nodes, class FeatureT>
+FernClassifier<Ferns, Nodes, FeatureT>::~FernClassifier() {
+    delete [] counts;
+    delete [] posteriors;
+    delete [] published[0];
+    delete [] published[1];
+}
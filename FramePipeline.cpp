@@ -0,0 +1,60 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "FramePipeline.h"
+
+
+FramePipeline::FramePipeline(Tracker *tracker, Detector *detector, FrameScheduler *scheduler) {
+    this->tracker = tracker;
+    this->detector = detector;
+    this->scheduler = scheduler;
+    threadPool = new ThreadPool(2);
+    nextFrame = NULL;
+    nextFrameIntImg = NULL;
+    bb = NULL;
+    predictedBB = NULL;
+    tbb = NULL;
+    detections = NULL;
+    focus = false;
+}
+
+
+void FramePipeline::process(IplImage *nextFrame, IntegralImage *nextFrameIntImg, double *bb, double *predictedBB, double *tbb, DetectionSet *detections, bool focus) {
+    this->nextFrame = nextFrame;
+    this->nextFrameIntImg = nextFrameIntImg;
+    this->bb = bb;
+    this->predictedBB = predictedBB;
+    this->tbb = tbb;
+    this->detections = detections;
+    this->focus = focus;
+    
+    if (detections == NULL) {
+        run(0);
+        return;
+    }
+    
+    // Track and detect, then label the detections against the tracked
+    // bounding-box
+    threadPool->run(this, 2);
+    detector->relabel(detections, tbb);
+}
+
+
+void FramePipeline::run(int index) {
+    if (index == 0) {
+        scheduler->beginStage(STAGE_TRACK);
+        tracker->track(nextFrame, nextFrameIntImg, bb, tbb);
+        scheduler->endStage(STAGE_TRACK);
+    } else {
+        scheduler->beginStage(STAGE_DETECT);
+        detector->detect(nextFrameIntImg, predictedBB, detections, focus, true);
+        scheduler->endStage(STAGE_DETECT);
+    }
+}
+
+
+FramePipeline::~FramePipeline() {
+    delete threadPool;
+}
@@ -0,0 +1,81 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "DetectionSet.h"
+#include "Detector.h"
+#include "FrameScheduler.h"
+#include "ThreadPool.h"
+#include "Tracker.h"
+
+
+/*  Tracks and detects in a frame concurrently.
+    
+    Detection only needs the tracked bounding-box for its base size, its
+    region of interest and to label the windows overlapping it, so it runs
+    around a prediction of it instead (see Tracker::predict), on a worker
+    thread,
+    while the tracker runs on the calling thread. The overlap labels are
+    settled once both have finished (see Detector::relabel), so a frame
+    takes about as long as the slower of the two rather than both.
+    
+    The worker is started once and reused, so processing a frame doesn't
+    allocate. */
+class FramePipeline : public ParallelTask {
+    // Private ===============================================================
+    private:
+    // Tracker and detector of the program, and the scheduler timing them
+    Tracker *tracker;
+    Detector *detector;
+    FrameScheduler *scheduler;
+    
+    // Pool of two threads, the calling thread and a worker, to run the
+    // stages on
+    ThreadPool *threadPool;
+    
+    // Arguments of the current call to process
+    IplImage *nextFrame;
+    IntegralImage *nextFrameIntImg;
+    double *bb;
+    double *predictedBB;
+    double *tbb;
+    DetectionSet *detections;
+    bool focus;
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        tracker: tracker to track with
+        detector: detector to detect with
+        scheduler: scheduler to time the stages with, constructed with
+            concurrent set */
+    FramePipeline(Tracker *tracker, Detector *detector, FrameScheduler *scheduler);
+    
+    /*  Tracks the object into the given frame and, unless detections is
+        NULL, detects it at the same time.
+        nextFrame: current frame; the tracker takes ownership of it as for
+            Tracker::track
+        nextFrameIntImg: current frame as an IntegralImage
+        bb: previous frame's trajectory bounding-box [x, y, width, height]
+        predictedBB: prediction of the tracked bounding-box
+            [x, y, width, height], e.g. bb, to detect around
+        tbb: array to store the tracked bounding-box and its confidence in
+            [x, y, width, height, confidence]
+        detections: set to store the detections in, labelled against the
+            tracked bounding-box (see Detector::detect), or NULL to only
+            track
+        focus: true to let the detector focus on predictedBB (see
+            Detector::detect) */
+    void process(IplImage *nextFrame, IntegralImage *nextFrameIntImg, double *bb, double *predictedBB, double *tbb, DetectionSet *detections, bool focus);
+    
+    /*  Runs one stage of the current call to process: 0 tracks and 1
+        detects. Called by the thread pool; not for use elsewhere.
+        index: index of the stage */
+    void run(int index);
+    
+    /*  Destructor. */
+    ~FramePipeline();
+};
@@ -0,0 +1,89 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "FramePool.h"
+
+
+FramePool::FramePool(int frameWidth, int frameHeight, int imageNum, int integralImageNum, bool integralImageSquares) {
+    width = frameWidth;
+    height = frameHeight;
+    squares = integralImageSquares;
+    
+    // Reserve twice the requested capacity so the pool can grow a little
+    // without reallocating its lists
+    images.reserve(imageNum * 2);
+    freeImages.reserve(imageNum * 2);
+    integralImages.reserve(integralImageNum * 2);
+    freeIntegralImages.reserve(integralImageNum * 2);
+    
+    for (int i = 0; i < imageNum; i++) {
+        IplImage *image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+        images.push_back(image);
+        freeImages.push_back(image);
+    }
+    
+    for (int i = 0; i < integralImageNum; i++) {
+        IntegralImage *image = new IntegralImage();
+        image->setBuildSquares(squares);
+        image->reserve(width, height);
+        integralImages.push_back(image);
+        freeIntegralImages.push_back(image);
+    }
+}
+
+
+IplImage *FramePool::acquireImage() {
+    // Grow the pool if every image is in use
+    if (freeImages.empty()) {
+        IplImage *image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+        images.push_back(image);
+        return image;
+    }
+    
+    IplImage *image = freeImages.back();
+    freeImages.pop_back();
+    return image;
+}
+
+
+void FramePool::releaseImage(IplImage *image) {
+    if (image != NULL) {
+        freeImages.push_back(image);
+    }
+}
+
+
+IntegralImage *FramePool::acquireIntegralImage() {
+    // Grow the pool if every integral image is in use
+    if (freeIntegralImages.empty()) {
+        IntegralImage *image = new IntegralImage();
+        image->setBuildSquares(squares);
+        image->reserve(width, height);
+        integralImages.push_back(image);
+        return image;
+    }
+    
+    IntegralImage *image = freeIntegralImages.back();
+    freeIntegralImages.pop_back();
+    return image;
+}
+
+
+void FramePool::releaseIntegralImage(IntegralImage *image) {
+    if (image != NULL) {
+        freeIntegralImages.push_back(image);
+    }
+}
+
+
+FramePool::~FramePool() {
+    for (int i = 0; i < (int)images.size(); i++) {
+        cvReleaseImage(&images[i]);
+    }
+    
+    for (int i = 0; i < (int)integralImages.size(); i++) {
+        delete integralImages[i];
+    }
+}
@@ -0,0 +1,70 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "opencv2/core/core_c.h"
+#include "IntegralImage.h"
+#include <vector>
+
+using namespace std;
+
+
+/*  A pool of frame-sized buffers shared by one TLD session. All frames
+    (IplImages) and integral images are allocated up front when the session
+    is initialised and then reused frame after frame, so the steady-state
+    frame loop makes no heap allocations.
+    
+    Buffers are acquired when a frame arrives and released once nothing
+    refers to them any longer; e.g. the Tracker keeps the previous frame and
+    releases it when the next one replaces it. If the pool runs dry it grows
+    by one buffer rather than failing, so an undersized pool shows up as
+    allocations (see AllocationCounter.h) rather than as a crash. */
+class FramePool {
+    // Private ===============================================================
+    private:
+    // Size of each frame
+    int width;
+    int height;
+    
+    // Whether the integral images build squared-sum tables
+    bool squares;
+    
+    // All images owned by the pool, and those currently available
+    vector<IplImage *> images;
+    vector<IplImage *> freeImages;
+    
+    // All integral images owned by the pool, and those currently available
+    vector<IntegralImage *> integralImages;
+    vector<IntegralImage *> freeIntegralImages;
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        frameWidth: width of the video stream frames
+        frameHeight: height of the video stream frames
+        imageNum: number of IplImages to allocate
+        integralImageNum: number of IntegralImages to allocate
+        integralImageSquares: true if the IntegralImages should build
+            squared-sum tables (see IntegralImage::setBuildSquares) */
+    FramePool(int frameWidth, int frameHeight, int imageNum, int integralImageNum, bool integralImageSquares);
+    
+    /*  Returns an unused frame-sized 8-bit greyscale image. */
+    IplImage *acquireImage(void);
+    
+    /*  Returns an image acquired from this pool to the pool.
+        image: image to release */
+    void releaseImage(IplImage *image);
+    
+    /*  Returns an unused IntegralImage with memory reserved for a frame. */
+    IntegralImage *acquireIntegralImage(void);
+    
+    /*  Returns an integral image acquired from this pool to the pool.
+        image: integral image to release */
+    void releaseIntegralImage(IntegralImage *image);
+    
+    /*  Destructor. Frees all buffers, including those still acquired. */
+    ~FramePool(void);
+};
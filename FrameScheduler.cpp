@@ -0,0 +1,147 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "FrameScheduler.h"
+#include <algorithm>
+
+
+FrameScheduler::FrameScheduler(double budgetMs, bool concurrent) {
+    budget = budgetMs;
+    this->concurrent = concurrent;
+    
+    for (int i = 0; i < SCHEDULER_STAGES; i++) {
+        costs[i] = 0;
+        measured[i] = false;
+        frameCosts[i] = 0;
+    }
+    
+    overhead = 0;
+    overheadMeasured = false;
+    level = LEVEL_FULL;
+    frameCount = 0;
+}
+
+
+double FrameScheduler::elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+void FrameScheduler::smooth(double *average, bool *isMeasured, double value) {
+    // The first measurement stands alone rather than being averaged with 0
+    if (*isMeasured) {
+        *average += SCHEDULER_SMOOTHING * (value - *average);
+    } else {
+        *average = value;
+        *isMeasured = true;
+    }
+}
+
+
+double FrameScheduler::predict(int level) {
+    double detectCost = level >= LEVEL_SPARSE_GRID ? costs[STAGE_DETECT] * SPARSE_DETECT_RATIO : costs[STAGE_DETECT];
+    double cost = overhead;
+    
+    if (concurrent) {
+        cost += std::max(costs[STAGE_TRACK], detectCost);
+    } else {
+        cost += costs[STAGE_TRACK] + detectCost;
+    }
+    
+    if (level < LEVEL_NO_LEARNING) {
+        cost += costs[STAGE_LEARN];
+    }
+    
+    return cost;
+}
+
+
+int FrameScheduler::beginFrame() {
+    frameStart = std::chrono::steady_clock::now();
+    frameCount++;
+    
+    for (int i = 0; i < SCHEDULER_STAGES; i++) {
+        frameCosts[i] = 0;
+    }
+    
+    if (budget <= 0) {
+        level = LEVEL_FULL;
+        return level;
+    }
+    
+    // Find the best level predicted to fit the budget. Alternate detection
+    // doesn't make the frames that detect any cheaper, so it is only the
+    // last resort
+    int target = LEVEL_ALTERNATE_DETECTION;
+    
+    for (int i = LEVEL_FULL; i < LEVEL_ALTERNATE_DETECTION; i++) {
+        if (predict(i) <= budget) {
+            target = i;
+            break;
+        }
+    }
+    
+    // Degrade straight away, but restore a level at a time and only with
+    // slack
+    if (target > level) {
+        level = target;
+    } else if (target < level && predict(level - 1) <= budget * SCHEDULER_SLACK) {
+        level--;
+    }
+    
+    return level;
+}
+
+
+void FrameScheduler::beginStage(int stage) {
+    stageStarts[stage] = std::chrono::steady_clock::now();
+}
+
+
+void FrameScheduler::endStage(int stage) {
+    double cost = elapsed(stageStarts[stage]);
+    frameCosts[stage] = cost;
+    
+    // Average detection costs in units of a full grid
+    if (stage == STAGE_DETECT && level >= LEVEL_SPARSE_GRID) {
+        cost /= SPARSE_DETECT_RATIO;
+    }
+    
+    smooth(&costs[stage], &measured[stage], cost);
+}
+
+
+void FrameScheduler::endFrame() {
+    // Everything not timed as a stage is overhead
+    double stageTotal = frameCosts[STAGE_LEARN];
+    
+    if (concurrent) {
+        stageTotal += std::max(frameCosts[STAGE_TRACK], frameCosts[STAGE_DETECT]);
+    } else {
+        stageTotal += frameCosts[STAGE_TRACK] + frameCosts[STAGE_DETECT];
+    }
+    
+    smooth(&overhead, &overheadMeasured, std::max(elapsed(frameStart) - stageTotal, 0.0));
+}
+
+
+int FrameScheduler::getLevel() {
+    return level;
+}
+
+
+int FrameScheduler::getScanPositions() {
+    return level >= LEVEL_SPARSE_GRID ? SPARSE_SCAN_POSITIONS : SCAN_POSITIONS;
+}
+
+
+bool FrameScheduler::shouldLearn() {
+    return level < LEVEL_NO_LEARNING;
+}
+
+
+bool FrameScheduler::shouldDetect() {
+    return level < LEVEL_ALTERNATE_DETECTION || frameCount % 2 == 0;
+}
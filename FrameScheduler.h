@@ -0,0 +1,137 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "ScanningGrid.h"
+#include <chrono>
+
+
+// Constants -----------------------------------------------------------------
+// Degradation levels, from full quality to the cheapest processing. Each
+// level keeps the savings of the levels before it
+#define LEVEL_FULL 0
+#define LEVEL_SPARSE_GRID 1
+#define LEVEL_NO_LEARNING 2
+#define LEVEL_ALTERNATE_DETECTION 3
+
+// Stages whose costs are measured
+#define STAGE_TRACK 0
+#define STAGE_DETECT 1
+#define STAGE_LEARN 2
+#define SCHEDULER_STAGES 3
+
+// Weight of each new measurement in the moving averages of the stage costs
+#define SCHEDULER_SMOOTHING 0.1
+
+// A better level is only restored once its predicted cost is below this
+// fraction of the budget, so the level doesn't flip-flop around the budget
+#define SCHEDULER_SLACK 0.8
+
+// Approximate cost of scanning a sparse grid relative to a full grid, i.e.
+// the ratio of their window counts
+#define SPARSE_DETECT_RATIO ((double)(SPARSE_SCAN_POSITIONS * SPARSE_SCAN_POSITIONS) / (SCAN_POSITIONS * SCAN_POSITIONS))
+
+
+/*  Keeps the processing of each frame within a latency budget by trading
+    quality for time.
+    
+    The cost of each stage is measured as frames are processed and smoothed
+    with an exponential moving average, along with the cost of everything
+    else done per frame. Before each frame, the best level predicted to fit
+    the budget is chosen, degrading in turn by scanning a sparse grid (see
+    SPARSE_SCAN_POSITIONS), skipping learning and detecting only every other
+    frame. Quality is restored a level at a time once there is slack.
+    
+    Detection costs are averaged in units of a full grid, scaling sparse
+    measurements by SPARSE_DETECT_RATIO, so the cost of restoring the full
+    grid stays up to date while it isn't scanned.
+    
+    Tracking and detection may run concurrently, in which case a frame is
+    predicted to cost the greater of the two rather than their sum, and
+    different stages may be timed from different threads.
+    
+    Scheduling doesn't allocate. */
+class FrameScheduler {
+    // Private ===============================================================
+    private:
+    // Frame budget in milliseconds, or 0 to always run at full quality
+    double budget;
+    
+    // Whether tracking and detection run concurrently
+    bool concurrent;
+    
+    // Smoothed cost in milliseconds of each stage when it runs at full
+    // quality, of everything else done per frame, and whether each has been
+    // measured yet
+    double costs[SCHEDULER_STAGES];
+    bool measured[SCHEDULER_STAGES];
+    double overhead;
+    bool overheadMeasured;
+    
+    // Level of the current frame
+    int level;
+    
+    // Number of frames begun so far
+    int frameCount;
+    
+    // Start of the current frame and of each stage, and the time measured in
+    // each stage this frame
+    std::chrono::steady_clock::time_point frameStart;
+    std::chrono::steady_clock::time_point stageStarts[SCHEDULER_STAGES];
+    double frameCosts[SCHEDULER_STAGES];
+    
+    /*  Returns the milliseconds elapsed since the given time.
+        start: time to measure from */
+    static double elapsed(std::chrono::steady_clock::time_point start);
+    
+    /*  Adds a measurement to a moving average.
+        average: average to update
+        isMeasured: whether the average has been measured; set by this
+        value: measured value */
+    static void smooth(double *average, bool *isMeasured, double value);
+    
+    /*  Returns the predicted cost in milliseconds of a frame processed at the
+        given level, for any frame on which detection runs.
+        level: degradation level */
+    double predict(int level);
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        budgetMs: latency budget of a frame in milliseconds, or 0 to disable
+            scheduling
+        concurrent: true if tracking and detection run concurrently */
+    FrameScheduler(double budgetMs, bool concurrent);
+    
+    /*  Starts timing a frame and chooses its level.
+        Returns the level (see LEVEL_FULL). */
+    int beginFrame(void);
+    
+    /*  Starts timing a stage of the current frame. Different stages may be
+        timed from different threads at once.
+        stage: the stage (see STAGE_TRACK) */
+    void beginStage(int stage);
+    
+    /*  Finishes timing a stage of the current frame, started by beginStage.
+        stage: the stage */
+    void endStage(int stage);
+    
+    /*  Finishes timing the current frame. */
+    void endFrame(void);
+    
+    /*  Returns the level of the current frame. */
+    int getLevel(void);
+    
+    /*  Returns the number of positions the detector should scan in each
+        dimension this frame (see ScanningGrid::build). */
+    int getScanPositions(void);
+    
+    /*  Returns true if the classifier may learn this frame. */
+    bool shouldLearn(void);
+    
+    /*  Returns true if the detector should run this frame. */
+    bool shouldDetect(void);
+};
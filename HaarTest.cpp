@@ -6,12 +6,12 @@
 #include "HaarTest.h"
 
 
-HaarTest::HaarTest(float minScale, float maxScale)
-: Feature(minScale, maxScale) {
+HaarTest::HaarTest(float minScale, float maxScale, std::mt19937 &random)
+: Feature(minScale, maxScale, random) {
 }
 
 
-int HaarTest::test(IntegralImage *image, int patchX, int patchY, int patchW, int patchH) {
+int HaarTest::test(const IntegralImageView &image, int patchX, int patchY, int patchW, int patchH) {
     // Compute the properties of the test rectangles relative to the size and
     // position of the patch
     int x = (int)(xp * (float)patchW) + patchX;
@@ -20,12 +20,27 @@ int HaarTest::test(IntegralImage *image, int patchX, int patchY, int patchW, int
     int h = (int)(hp * (float)patchH);
     
     // Compare the left and right halfs of the feature on the patch
-    int left = image->sumRect(x, y, w, h);
-    int right = image->sumRect(x + w, y, w, h);
+    int left = image.sumRectUnchecked(x, y, w, h);
+    int right = image.sumRectUnchecked(x + w, y, w, h);
     
     return (left > right ? 0 : 1);
 }
 
 
+void HaarTest::getOffsets(int patchW, int patchH, int stride, int *offsets) {
+    // Compute the test rectangle exactly as in test, relative to the patch
+    int x = (int)(xp * (float)patchW);
+    int y = (int)(yp * (float)patchH);
+    int w = (int)(wp * (float)patchW * 0.5f);
+    int h = (int)(hp * (float)patchH);
+    
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            offsets[j * 3 + i] = (y + j * h) * stride + x + i * w;
+        }
+    }
+}
+
+
 HaarTest::~HaarTest() {
 }
@@ -6,6 +6,7 @@
 #pragma once
 #include "Feature.h"
 #include "IntegralImage.h"
+#include "Simd.h"
 #include <cstdlib>
 
 
@@ -17,29 +18,80 @@
     Tests are performed on integral images (using the IntegralImage class) for
     efficiency.
     
-    Note: srand(time(0)) should be called before initialising any instances
-    of HaarTest.
-    
     Note: typically a value of TOTAL_NODES = 13 is chosen in TLD.cpp when
     using this feature in Fern. */
 class HaarTest : public Feature {
     // Public ================================================================
     public:
+    // Power of 2 giving the number of possible return values of test, i.e.
+    // 2 (2 ^ 1) possible return values
+    static const int POWER = 1;
+    
+    /*  Constructor. Leaves the feature uninitialised. */
+    HaarTest(void) {}
+    
     /*  Constructor.
         minScale: minimum percentage of the patch width and height the feature
             can take
         maxScale: maximum percentage of the patch width and height the feature
-            can take */
-    HaarTest(float minScale, float maxScale);
+            can take
+        random: random number generator to place the feature with */
+    HaarTest(float minScale, float maxScale, std::mt19937 &random);
     
     /*  Tests the input patch.
         Returns 0 if the left area intensity is greatest, otherwise 1.
-        image: image to take patch from
+        The patch must lie within the image and have non-negative
+        dimensions (see Fern::getLeafIndex) as no bounds checking is done.
+        image: view of the image to take patch from
         patchX: patch top-left x-position
         patchX: patch top-left y-position
         patchW: patch width
         patchH: patch height */
-    int test(IntegralImage *image, int patchX, int patchY, int patchW, int patchH);
+    int test(const IntegralImageView &image, int patchX, int patchY, int patchW, int patchH);
+    
+    /*  Computes the integral image offsets of the FEATURE_OFFSETS points
+        describing this feature on a patch of the given size, relative to the
+        patch's top-left element, for use with testOffsets.
+        patchW: patch width
+        patchH: patch height
+        stride: stride of the integral image the patch is in
+        offsets: array of FEATURE_OFFSETS elements to store the offsets in */
+    void getOffsets(int patchW, int patchH, int stride, int *offsets);
+    
+    /*  Tests a patch given the offsets computed by getOffsets for its size.
+        Returns the same value as test would for the patch.
+        patch: pointer to the integral image element at the patch's top-left
+        offsets: offsets computed by getOffsets */
+    static inline int testOffsets(const int *patch, const int *offsets) {
+        // Points are numbered row by row on the 3x3 lattice; the last row
+        // is unused
+        int left = patch[offsets[0]] + patch[offsets[4]] - patch[offsets[1]] - patch[offsets[3]];
+        int right = patch[offsets[1]] + patch[offsets[5]] - patch[offsets[2]] - patch[offsets[4]];
+        return (left > right ? 0 : 1);
+    }
+    
+#ifdef TLD_AVX2
+    /*  Tests 8 patches of the same size at once using AVX2 gathers.
+        Returns the results of testOffsets for each patch.
+        origin: pointer to the integral image element (0, 0)
+        patches: offsets of the patches' top-left elements from origin
+        offsets: offsets computed by getOffsets for the patch size */
+    static inline __m256i testOffsets8(const int *origin, __m256i patches, const int *offsets) {
+        // Only the first two rows of the lattice are used
+        __m256i p[6];
+        
+        for (int i = 0; i < 6; i++) {
+            __m256i index = _mm256_add_epi32(patches, _mm256_set1_epi32(offsets[i]));
+            p[i] = _mm256_i32gather_epi32(origin, index, 4);
+        }
+        
+        __m256i left = _mm256_sub_epi32(_mm256_add_epi32(p[0], p[4]), _mm256_add_epi32(p[1], p[3]));
+        __m256i right = _mm256_sub_epi32(_mm256_add_epi32(p[1], p[5]), _mm256_add_epi32(p[2], p[4]));
+        
+        // The comparison gives all bits set where true
+        return _mm256_andnot_si256(_mm256_cmpgt_epi32(left, right), _mm256_set1_epi32(1));
+    }
+#endif
     
     /*  Destructor. */
     ~HaarTest();
@@ -4,60 +4,265 @@
     Foundation. This software is provided without warranty of ANY kind. */
 
 #include "IntegralImage.h"
+#include "Simd.h"
+#include <string.h>
 
 
-IntegralImage::IntegralImage() {}
+/*  Adds each element of the previous row of an integral image to the
+    corresponding element of the current row.
+    row: current row
+    prevRow: previous row
+    count: number of elements to add */
+static void accumulateRow(int *row, const int *prevRow, int count) {
+    int i = 0;
+    
+#if defined(TLD_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(row + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(prevRow + i));
+        _mm256_storeu_si256((__m256i *)(row + i), _mm256_add_epi32(a, b));
+    }
+#elif defined(TLD_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(prevRow + i));
+        _mm_storeu_si128((__m128i *)(row + i), _mm_add_epi32(a, b));
+    }
+#endif
+    
+    for (; i < count; i++) {
+        row[i] += prevRow[i];
+    }
+}
 
 
-void IntegralImage::createFromMatlab(const mxArray *mxImage) {
-    // Get pointer
-    unsigned char *values = (unsigned char *)mxGetPr(mxImage);
+/*  Computes one row of an integral image from a row of pixels, i.e.
+    row[i] = prevRow[i] + pixels[0] + ... + pixels[i].
+    The running sum along the row is kept in registers and computed a vector
+    at a time with a log-step prefix sum.
+    pixels: row of pixel values
+    prevRow: previous integral image row, excluding its leading zero
+    row: row to compute, excluding its leading zero
+    count: number of pixels in the row */
+static void buildRow(const uint8_t *pixels, const int *prevRow, int *row, int count) {
+    int i = 0;
+    int rowSum = 0;
     
-    // Get width and height
-    width = (int)mxGetN(mxImage);
-    height = (int)mxGetM(mxImage);
+#if defined(TLD_AVX2)
+    __m256i carry = _mm256_setzero_si256();
+    __m256i last = _mm256_set1_epi32(7);
     
-    // Create our image
-    data = new int *[width + 1];
+    for (; i + 8 <= count; i += 8) {
+        // Widen 8 pixels to 32-bit and compute their prefix sum within each
+        // 128-bit lane, then add the low lane's total to the high lane
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(pixels + i)));
+        v = _mm256_add_epi32(v, _mm256_slli_si256(v, 4));
+        v = _mm256_add_epi32(v, _mm256_slli_si256(v, 8));
+        __m256i lowTotal = _mm256_shuffle_epi32(v, 0xFF);
+        v = _mm256_add_epi32(v, _mm256_permute2x128_si256(lowTotal, lowTotal, 0x08));
+        
+        // Add the sum of all preceding pixels, then the row above
+        v = _mm256_add_epi32(v, carry);
+        carry = _mm256_permutevar8x32_epi32(v, last);
+        __m256i above = _mm256_loadu_si256((const __m256i *)(prevRow + i));
+        _mm256_storeu_si256((__m256i *)(row + i), _mm256_add_epi32(v, above));
+    }
     
-    // Zero first column
-    data[0] = new int[height + 1];
+    rowSum = _mm_cvtsi128_si32(_mm256_castsi256_si128(carry));
+#elif defined(TLD_SSE2)
+    __m128i carry = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
     
-    for (int j = 0; j <= height; j++) {
-        data[0][j] = 0;
+    for (; i + 4 <= count; i += 4) {
+        // Widen 4 pixels to 32-bit and compute their prefix sum
+        int packed;
+        memcpy(&packed, pixels + i, sizeof(int));
+        __m128i v = _mm_cvtsi32_si128(packed);
+        v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+        
+        // Add the sum of all preceding pixels, then the row above
+        v = _mm_add_epi32(v, carry);
+        carry = _mm_shuffle_epi32(v, 0xFF);
+        __m128i above = _mm_loadu_si128((const __m128i *)(prevRow + i));
+        _mm_storeu_si128((__m128i *)(row + i), _mm_add_epi32(v, above));
     }
     
-    // Loop through the data taking values from the matlab image
-    for (int i = 1; i <= width; i++) {
-        data[i] = new int[height + 1];
-        data[i][0] = 0;
+    rowSum = _mm_cvtsi128_si32(carry);
+#endif
+    
+    for (; i < count; i++) {
+        rowSum += pixels[i];
+        row[i] = prevRow[i] + rowSum;
+    }
+}
+
+
+IntegralImage::IntegralImage() {
+    data = NULL;
+    buffer = NULL;
+    capacity = 0;
+    width = 0;
+    height = 0;
+    stride = 0;
+    squares = NULL;
+    squaresBuffer = NULL;
+    squaresCapacity = 0;
+    buildSquares = false;
+    squaresValid = false;
+}
+
+
+void IntegralImage::allocate(int w, int h) {
+    int alignInts = INTEGRAL_IMAGE_ALIGNMENT / sizeof(int);
+    stride = strideFor(w);
+    width = w;
+    height = h;
+    int required = stride * (h + 1);
+    
+    // Reuse our existing buffer if it is large enough
+    if (buffer == NULL || required > capacity) {
+        delete [] buffer;
         
-        for (int j = 1; j <= height; j++) {
-            data[i][j] = values[(i - 1) * height + (j - 1)] + data[i - 1][j] + data[i][j - 1] - data[i - 1][j - 1];
+        // Over-allocate by one aligned block so data can be aligned within
+        buffer = new int[required + alignInts];
+        capacity = required;
+    }
+    
+    size_t address = (size_t)buffer;
+    size_t offset = (INTEGRAL_IMAGE_ALIGNMENT - address % INTEGRAL_IMAGE_ALIGNMENT) % INTEGRAL_IMAGE_ALIGNMENT;
+    data = (int *)(address + offset);
+    squaresValid = false;
+}
+
+
+void IntegralImage::allocateSquares() {
+    int alignElements = INTEGRAL_IMAGE_ALIGNMENT / sizeof(int64_t);
+    int required = stride * (height + 1);
+    
+    // Reuse our existing buffer if it is large enough
+    if (squaresBuffer == NULL || required > squaresCapacity) {
+        delete [] squaresBuffer;
+        squaresBuffer = new int64_t[required + alignElements];
+        squaresCapacity = required;
+    }
+    
+    size_t address = (size_t)squaresBuffer;
+    size_t offset = (INTEGRAL_IMAGE_ALIGNMENT - address % INTEGRAL_IMAGE_ALIGNMENT) % INTEGRAL_IMAGE_ALIGNMENT;
+    squares = (int64_t *)(address + offset);
+}
+
+
+void IntegralImage::createSquares(const uint8_t *values, int valuesStep, int valuesStride) {
+    allocateSquares();
+    
+    // Zero first row
+    memset(squares, 0, (width + 1) * sizeof(int64_t));
+    
+    // As for the sum table, each element is the running sum along its row
+    // plus the element above
+    for (int j = 1; j <= height; j++) {
+        const uint8_t *pixels = values + (j - 1) * valuesStride;
+        int64_t *row = squares + j * stride;
+        const int64_t *prevRow = row - stride;
+        int64_t rowSum = 0;
+        row[0] = 0;
+        
+        for (int i = 1; i <= width; i++) {
+            int value = pixels[(i - 1) * valuesStep];
+            rowSum += value * value;
+            row[i] = prevRow[i] + rowSum;
         }
     }
     
-    containsFreeableData = true;
+    squaresValid = true;
 }
 
 
-void IntegralImage::createFromIntegralImage(IntegralImage *image, int x, int y, int w, int h) {
-    // Check we don't exceed image dimensions
-    // Note: assumes all parameters are positive
-    if (x + w <= image->getWidth() && y + h <= image->getHeight()) {
-        width = w;
-        height = h;
-        containsFreeableData = false;
-        int **imageData = image->getData();
-        data = new int *[w + 1];
+void IntegralImage::reserve(int w, int h) {
+    allocate(w, h);
+    
+    if (buildSquares) {
+        allocateSquares();
+    }
+}
+
+
+void IntegralImage::setBuildSquares(bool enabled) {
+    buildSquares = enabled;
+}
+
+
+bool IntegralImage::hasSquares() {
+    return squaresValid;
+}
+
+
+void IntegralImage::createFromMatlab(const mxArray *mxImage) {
+    // Get pointer
+    unsigned char *values = (unsigned char *)mxGetPr(mxImage);
+    
+    // Get width and height and create our image
+    allocate((int)mxGetN(mxImage), (int)mxGetM(mxImage));
+    
+    // Zero first row
+    memset(data, 0, (width + 1) * sizeof(int));
+    
+    // Loop through the data taking values from the matlab image, which is
+    // stored column by column. Each row is first filled with the running sum
+    // along the row, then the row above is added to it in a vectorised pass
+    for (int j = 1; j <= height; j++) {
+        int *row = data + j * stride;
+        int rowSum = 0;
+        row[0] = 0;
         
-        // Assign each value in our data array to a pointer to the correct
-        // element in our original array
-        for (int i = 0; i <= w; i++) {
-            data[i] = &(imageData[x + i][y]);
+        for (int i = 1; i <= width; i++) {
+            rowSum += values[(i - 1) * height + (j - 1)];
+            row[i] = rowSum;
         }
+        
+        accumulateRow(row + 1, row + 1 - stride, width);
+    }
+    
+    // Matlab images are stored column by column
+    if (buildSquares) {
+        createSquares(values, height, 1);
+    }
+}
+
+
+void IntegralImage::createFromBuffer(const uint8_t *values, int w, int h, int valuesStride) {
+    allocate(w, h);
+    
+    // Zero first row
+    memset(data, 0, (width + 1) * sizeof(int));
+    
+    // Build each row from the corresponding row of pixels and the row above
+    for (int j = 1; j <= height; j++) {
+        int *row = data + j * stride;
+        row[0] = 0;
+        buildRow(values + (j - 1) * valuesStride, row + 1 - stride, row + 1, width);
+    }
+    
+    if (buildSquares) {
+        createSquares(values, 1, valuesStride);
+    }
+}
+
+
+IntegralImageView IntegralImage::view() {
+    return IntegralImageView(data, stride, width, height);
+}
+
+
+IntegralImageView IntegralImage::view(int x, int y, int w, int h) {
+    // Check we don't exceed image dimensions
+    if (x >= 0 && y >= 0 && w >= 0 && h >= 0 && x + w <= width && y + h <= height) {
+        return IntegralImageView(data + y * stride + x, stride, w, h);
     } else {
         printf("ERROR: IMAGE SIZE OUT OF BOUNDS! (%d, %d, %d, %d)\n", x, y, w, h);
+        return IntegralImageView();
     }
 }
 
@@ -65,11 +270,9 @@ void IntegralImage::createFromIntegralImage(IntegralImage *image, int x, int y,
 void IntegralImage::createWarp(IntegralImage *image, double *bb, float *m) {
     // Initialise variables
     // Remember an IntegralImage has dimensions (width + 1)x(height + 1)
-    width = (int)bb[2];
-    height = (int)bb[3];
-    containsFreeableData = true;
-    data = new int *[width + 1];
-    int **imageData = image->getData();
+    allocate((int)bb[2], (int)bb[3]);
+    int *imageData = image->getData();
+    int imageStride = image->getStride();
     
     // Get centre of bounding-box (cx, cy) and the offset relative to this of
     // the top-left of the bounding-box (ox, oy)
@@ -78,12 +281,12 @@ void IntegralImage::createWarp(IntegralImage *image, double *bb, float *m) {
     int cx = (int)(bb[0] - ox);
     int cy = (int)(bb[1] - oy);
     
-    // Loop through pixels of this image, width then height, calculating the
+    // Loop through pixels of this image, height then width, calculating the
     // position of corresponding pixels in the source image
-    for (int x = ox; x <= ox + width; x++) {
-        data[x - ox] = new int[height + 1];
+    for (int y = oy; y <= oy + height; y++) {
+        int *row = data + (y - oy) * stride;
         
-        for (int y = oy; y <= oy + height; y++) {
+        for (int x = ox; x <= ox + width; x++) {
             int xp = (int)(m[0] * (float)x + m[1] * (float)y + cx);
             int yp = (int)(m[2] * (float)x + m[3] * (float)y + cy);
             
@@ -91,20 +294,14 @@ void IntegralImage::createWarp(IntegralImage *image, double *bb, float *m) {
             xp = std::max(std::min(xp, (int)bb[0] + width), (int)bb[0]);
             yp = std::max(std::min(yp, (int)bb[1] + height), (int)bb[1]);
             
-            data[x - ox][y - oy] = imageData[xp][yp];
+            row[x - ox] = imageData[yp * imageStride + xp];
         }
     }
 }
 
 
 int IntegralImage::sumRect(int x, int y, int w, int h) {
-    // Check all parameters are positive and within the image bounds
-    if (x >= 0 && w > 0 && x + w <= width && y >= 0 && h > 0 && y + h <= height) {
-        return data[x][y] + data[x + w][y + h] - data[x + w][y] - data[x][y + h];
-    } else {
-        printf("ERROR: SUM RECT OUT OF BOUNDS! (%d, %d, %d, %d)\n", x, y, w, h);
-        return 0;
-    }
+    return view().sumRect(x, y, w, h);
 }
 
 
@@ -118,23 +315,24 @@ int IntegralImage::getHeight() {
 }
 
 
-int **IntegralImage::getData() {
-    return data;
+int IntegralImage::getStride() {
+    return stride;
+}
+
+
+int IntegralImage::strideFor(int w) {
+    // Round the row length up to a whole number of aligned blocks
+    int alignInts = INTEGRAL_IMAGE_ALIGNMENT / sizeof(int);
+    return ((w + 1 + alignInts - 1) / alignInts) * alignInts;
 }
 
 
-void IntegralImage::setData(int **d) {
-    data = d;
+int *IntegralImage::getData() {
+    return data;
 }
 
 
 IntegralImage::~IntegralImage() {
-    // Only delete all the data if it was created from Matlab
-    if (containsFreeableData) {
-        for (int i = 0; i <= width; i++) {
-            delete [] data[i];
-        }
-    }
-    
-    delete [] data;
+    delete [] buffer;
+    delete [] squaresBuffer;
 }
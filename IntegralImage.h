@@ -6,6 +6,100 @@
 #pragma once
 #include "mex.h"
 #include <algorithm>
+#include <stdint.h>
+
+
+// Constants -----------------------------------------------------------------
+// Alignment in bytes of the integral image buffer and of each of its rows.
+// 32 bytes allows aligned loads of 8 ints at a time
+#define INTEGRAL_IMAGE_ALIGNMENT 32
+
+
+/*  A view of a rectangular region of an IntegralImage. A view is a plain
+    value holding a pointer into the image's data, so creating, copying and
+    passing one around never allocates; views can live on the stack and be
+    handed out freely for sub-windows of a frame.
+    
+    A view is only valid as long as the image it was taken from is neither
+    destroyed nor re-created. */
+class IntegralImageView {
+    // Private ===============================================================
+    private:
+    // Pointer to the integral image element at the top-left of this view
+    const int *origin;
+    
+    // Number of ints between the starts of consecutive rows of the image
+    int stride;
+    
+    // Dimensions of the view
+    int width, height;
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor. Creates an empty view. */
+    IntegralImageView(void) : origin(NULL), stride(0), width(0), height(0) {}
+    
+    /*  Constructor.
+        origin: pointer to the integral image element at the top-left
+        stride: number of ints between the starts of consecutive rows
+        width: width of the view
+        height: height of the view */
+    IntegralImageView(const int *origin, int stride, int width, int height)
+    : origin(origin), stride(stride), width(width), height(height) {}
+    
+    /*  Returns a view of a region of this view. Performs no bounds checking.
+        x: top-left x-position of the region relative to this view
+        y: top-left y-position of the region relative to this view
+        w: width of the region
+        h: height of the region */
+    inline IntegralImageView subView(int x, int y, int w, int h) const {
+        return IntegralImageView(origin + y * stride + x, stride, w, h);
+    }
+    
+    /*  Returns the sum of pixel intensities in the rectangular area
+        designated by the given parameters, relative to this view, or 0 with
+        an error message if the area is not within the view.
+        x: top-left x-position of rectangle
+        y: top-left y-position of rectangle
+        w: width of rectangle
+        h: height of rectangle */
+    inline int sumRect(int x, int y, int w, int h) const {
+        // Check all parameters are positive and within the view bounds
+        if (x >= 0 && w > 0 && x + w <= width && y >= 0 && h > 0 && y + h <= height) {
+            return sumRectUnchecked(x, y, w, h);
+        } else {
+            printf("ERROR: SUM RECT OUT OF BOUNDS! (%d, %d, %d, %d)\n", x, y, w, h);
+            return 0;
+        }
+    }
+    
+    /*  As sumRect, but performs no bounds checking. Use only when the
+        rectangle is already known to lie within the view, i.e. x, y, w and
+        h are non-negative, x + w <= width and y + h <= height. A rectangle of
+        zero width or height sums to 0.
+        x: top-left x-position of rectangle
+        y: top-left y-position of rectangle
+        w: width of rectangle
+        h: height of rectangle */
+    inline int sumRectUnchecked(int x, int y, int w, int h) const {
+        const int *top = origin + y * stride + x;
+        const int *bottom = top + h * stride;
+        return top[0] + bottom[w] - top[w] - bottom[0];
+    }
+    
+    /*  Getter for origin. */
+    inline const int *getOrigin(void) const { return origin; }
+    
+    /*  Getter for stride. */
+    inline int getStride(void) const { return stride; }
+    
+    /*  Getter for width. */
+    inline int getWidth(void) const { return width; }
+    
+    /*  Getter for height. */
+    inline int getHeight(void) const { return height; }
+};
 
 
 /*  An integral image, or summed area table, allows fast computation of 
@@ -18,30 +112,73 @@
     The intensity sum of a rectangle can then be computed by:
         top-left + bottom-right - top-right - bottom-left
     
-    Integral images are stored in a 2D array as such:
-        0 0 0 0 0 0
-        0 - - - - -
-        0 - - - - -
-        0 - - - - -
-        0 - - - - -
+    Integral images are stored row by row in a single contiguous buffer as
+    such:
+        0 0 0 0 0 0 . .
+        0 - - - - - . .
+        0 - - - - - . .
+        0 - - - - - . .
+        0 - - - - - . .
     
     where width = image width + 1, height = image height + 1, dashes represent
-    elements containing sums from the original image, and zeros represent the
-    top row and left column, which hold only zeros. */
+    elements containing sums from the original image, zeros represent the
+    top row and left column, which hold only zeros, and dots represent
+    padding. Element (x, y) is found at data[y * stride + x], where stride is
+    width + 1 rounded up so that every row starts on an aligned boundary.
+    
+    Optionally (see setBuildSquares), a second table of the same layout
+    holding sums of squared pixel intensities is built alongside, so the
+    variance of any rectangle can be computed in constant time. Its elements
+    are 64-bit as squared sums of a frame overflow 32 bits. */
 class IntegralImage {
     // Private ===============================================================
     private:
-    // 2-dimensional array containing values of the integral image
-    int **data;
+    // Pointer to element (0, 0) of the integral image
+    int *data;
+    
+    // Block of memory owned by this instance that data points into. Regions
+    // of it are shared without copying through IntegralImageView
+    int *buffer;
+    
+    // Number of ints available in buffer after alignment. The buffer is only
+    // reallocated when an image larger than this is created, so instances can
+    // be reused frame after frame without allocating
+    int capacity;
     
     // Dimensions of the image
     int width, height;
     
-    // If this image was created from Matlab or as a warp, its data was copied
-    // by value, otherwise it was copied by reference and cannot be freed.
-    // This information is important as we only free the data upon destruction
-    // if this is the case
-    bool containsFreeableData;
+    // Number of ints between the starts of consecutive rows of data
+    int stride;
+    
+    // Pointer to element (0, 0) of the squared-sum table, laid out as data
+    int64_t *squares;
+    
+    // Block of memory owned by this instance that squares points into, and
+    // the number of elements available in it after alignment
+    int64_t *squaresBuffer;
+    int squaresCapacity;
+    
+    // Whether the squared-sum table is built by createFromMatlab and
+    // createFromBuffer, and whether it holds the sums of the current image
+    bool buildSquares;
+    bool squaresValid;
+    
+    /*  Ensures buffer is large enough for an image of the given dimensions,
+        points data at it and sets width, height and stride.
+        w: image width
+        h: image height */
+    void allocate(int w, int h);
+    
+    /*  Ensures squaresBuffer is large enough for the current dimensions and
+        points squares at it. */
+    void allocateSquares(void);
+    
+    /*  Builds the squared-sum table from a raw 8-bit greyscale buffer.
+        values: pointer to the top-left pixel
+        valuesStep: number of bytes between horizontally adjacent pixels
+        valuesStride: number of bytes between vertically adjacent pixels */
+    void createSquares(const uint8_t *values, int valuesStep, int valuesStride);
     
     
     // Public ================================================================
@@ -49,18 +186,44 @@ class IntegralImage {
     /*  Constructor. */
     IntegralImage(void);
     
+    /*  Allocates memory for an image of the given dimensions up front, so
+        that creating an image no larger than this later does not allocate.
+        w: image width
+        h: image height */
+    void reserve(int w, int h);
+    
+    /*  Sets whether createFromMatlab and createFromBuffer also build the
+        squared-sum table. Off by default. createWarp never builds it.
+        enabled: true to build the squared-sum table */
+    void setBuildSquares(bool enabled);
+    
+    /*  Returns true if the squared-sum table holds the sums of the current
+        image. */
+    bool hasSquares(void);
+    
     /*  Creates an integral image from Matlab.
         mxImage: the image straight from Matlab */
     void createFromMatlab(const mxArray *mxImage);
     
-    /*  Instantiates this instance with a patch of another IntegralImage
-        specified by the given parameters.
-        image: image to take patch from
+    /*  Creates an integral image from a raw 8-bit greyscale buffer stored
+        row by row. The table is built with SIMD instructions where available
+        (see Simd.h).
+        values: pointer to the top-left pixel
+        w: image width
+        h: image height
+        valuesStride: number of bytes between the starts of consecutive rows */
+    void createFromBuffer(const uint8_t *values, int w, int h, int valuesStride);
+    
+    /*  Returns a view of the whole image. */
+    IntegralImageView view(void);
+    
+    /*  Returns a view of a patch of this image, without copying any data, or
+        an empty view with an error message if the patch is out of bounds.
         x: top-left x-dimension point of the patch
         y: top-left y-dimension point of the patch
         w: width to take
         h: height to take */
-    void createFromIntegralImage(IntegralImage *image, int x, int y, int w, int h);
+    IntegralImageView view(int x, int y, int w, int h);
     
     /*  Instantiates this instance containing the contents of the bounding-box
         in the given image instance warped by the given matrix.
@@ -77,22 +240,60 @@ class IntegralImage {
         h: height of rectangle */
     int sumRect(int x, int y, int w, int h);
     
+    /*  As sumRect, but performs no bounds checking. Use only when the
+        rectangle is already known to lie within the image, i.e. x, y, w and
+        h are non-negative, x + w <= width and y + h <= height. A rectangle of
+        zero width or height sums to 0.
+        x: top-left x-position of rectangle
+        y: top-left y-position of rectangle
+        w: width of rectangle
+        h: height of rectangle */
+    inline int sumRectUnchecked(int x, int y, int w, int h) {
+        const int *top = data + y * stride + x;
+        const int *bottom = top + h * stride;
+        return top[0] + bottom[w] - top[w] - bottom[0];
+    }
+    
+    /*  Returns the variance of the pixel intensities in the rectangular area
+        designated by the given parameters. Requires the squared-sum table
+        (see hasSquares) and performs no bounds checking, as for
+        sumRectUnchecked. The rectangle MUST NOT be empty.
+        x: top-left x-position of rectangle
+        y: top-left y-position of rectangle
+        w: width of rectangle
+        h: height of rectangle */
+    inline double varianceUnchecked(int x, int y, int w, int h) {
+        const int64_t *top = squares + y * stride + x;
+        const int64_t *bottom = top + h * stride;
+        int64_t squareSum = top[0] + bottom[w] - top[w] - bottom[0];
+        int64_t sum = sumRectUnchecked(x, y, w, h);
+        int64_t area = (int64_t)w * h;
+        
+        // E[X^2] - E[X]^2, with the numerator computed exactly in integers
+        // so the result is never negative
+        return (double)(squareSum * area - sum * sum) / ((double)area * (double)area);
+    }
+    
     /*  Getter for width. */
     int getWidth(void);
     
     /*  Getter for height. */
     int getHeight(void);
     
+    /*  Getter for stride. */
+    int getStride(void);
+    
+    /*  Returns the stride of an integral image of an image of the given
+        width.
+        w: image width */
+    static int strideFor(int w);
+    
     /*  Destructor. */
     ~IntegralImage(void);
     
     
     // Protected =============================================================
     protected:
-    /*  Sets the data field by reference, i.e. the array is not copied.
-        d: data to set */
-    void setData(int **d);
-    
     /*  Returns the data field of this instance. */
-    int **getData(void);
+    int *getData(void);
 };
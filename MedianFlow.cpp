@@ -0,0 +1,240 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "MedianFlow.h"
+#include "Simd.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+
+MedianFlow::MedianFlow(int maxPoints, int pairSamples) {
+    this->maxPoints = maxPoints;
+    this->pairSamples = pairSamples;
+    prevX = (float *)malloc(maxPoints * sizeof(float));
+    prevY = (float *)malloc(maxPoints * sizeof(float));
+    nextX = (float *)malloc(maxPoints * sizeof(float));
+    nextY = (float *)malloc(maxPoints * sizeof(float));
+    dxs = (float *)malloc(maxPoints * sizeof(float));
+    dys = (float *)malloc(maxPoints * sizeof(float));
+    
+    // Only as many ratios as are sampled are needed once pairs are sampled
+    int pairs = maxPoints * (maxPoints - 1) / 2;
+    
+    if (pairSamples > 0 && pairSamples < pairs) {
+        pairs = pairSamples;
+    }
+    
+    ratios = (float *)malloc(std::max(pairs, 1) * sizeof(float));
+    seed = 2463534242u;
+}
+
+
+unsigned int MedianFlow::random() {
+    // Xorshift, so sampling doesn't touch the global state of rand
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+
+int MedianFlow::allRatios(int count) {
+    int stored = 0;
+    
+    for (int i = 0; i < count; i++) {
+        float px = prevX[i];
+        float py = prevY[i];
+        float nx = nextX[i];
+        float ny = nextY[i];
+        int j = i + 1;
+        
+        // Pairs are stored a vector at a time, then moved back over any
+        // pair with a zero distance
+#if defined(TLD_AVX2)
+        __m256 px8 = _mm256_set1_ps(px);
+        __m256 py8 = _mm256_set1_ps(py);
+        __m256 nx8 = _mm256_set1_ps(nx);
+        __m256 ny8 = _mm256_set1_ps(ny);
+        __m256 zero = _mm256_setzero_ps();
+        
+        for (; j + 8 <= count; j += 8) {
+            __m256 pdx = _mm256_sub_ps(_mm256_loadu_ps(prevX + j), px8);
+            __m256 pdy = _mm256_sub_ps(_mm256_loadu_ps(prevY + j), py8);
+            __m256 ndx = _mm256_sub_ps(_mm256_loadu_ps(nextX + j), nx8);
+            __m256 ndy = _mm256_sub_ps(_mm256_loadu_ps(nextY + j), ny8);
+            __m256 prev = _mm256_add_ps(_mm256_mul_ps(pdx, pdx), _mm256_mul_ps(pdy, pdy));
+            __m256 next = _mm256_add_ps(_mm256_mul_ps(ndx, ndx), _mm256_mul_ps(ndy, ndy));
+            int valid = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(prev, zero, _CMP_NEQ_OQ), _mm256_cmp_ps(next, zero, _CMP_NEQ_OQ)));
+            __m256 ratio = _mm256_div_ps(next, prev);
+            
+            if (valid == 0xFF) {
+                _mm256_storeu_ps(ratios + stored, ratio);
+                stored += 8;
+            } else {
+                float lanes[8];
+                _mm256_storeu_ps(lanes, ratio);
+                
+                for (int k = 0; k < 8; k++) {
+                    ratios[stored] = lanes[k];
+                    stored += (valid >> k) & 1;
+                }
+            }
+        }
+#elif defined(TLD_SSE2)
+        __m128 px4 = _mm_set1_ps(px);
+        __m128 py4 = _mm_set1_ps(py);
+        __m128 nx4 = _mm_set1_ps(nx);
+        __m128 ny4 = _mm_set1_ps(ny);
+        __m128 zero = _mm_setzero_ps();
+        
+        for (; j + 4 <= count; j += 4) {
+            __m128 pdx = _mm_sub_ps(_mm_loadu_ps(prevX + j), px4);
+            __m128 pdy = _mm_sub_ps(_mm_loadu_ps(prevY + j), py4);
+            __m128 ndx = _mm_sub_ps(_mm_loadu_ps(nextX + j), nx4);
+            __m128 ndy = _mm_sub_ps(_mm_loadu_ps(nextY + j), ny4);
+            __m128 prev = _mm_add_ps(_mm_mul_ps(pdx, pdx), _mm_mul_ps(pdy, pdy));
+            __m128 next = _mm_add_ps(_mm_mul_ps(ndx, ndx), _mm_mul_ps(ndy, ndy));
+            int valid = _mm_movemask_ps(_mm_and_ps(_mm_cmpneq_ps(prev, zero), _mm_cmpneq_ps(next, zero)));
+            __m128 ratio = _mm_div_ps(next, prev);
+            
+            if (valid == 0xF) {
+                _mm_storeu_ps(ratios + stored, ratio);
+                stored += 4;
+            } else {
+                float lanes[4];
+                _mm_storeu_ps(lanes, ratio);
+                
+                for (int k = 0; k < 4; k++) {
+                    ratios[stored] = lanes[k];
+                    stored += (valid >> k) & 1;
+                }
+            }
+        }
+#endif
+        
+        for (; j < count; j++) {
+            float pdx = prevX[j] - px;
+            float pdy = prevY[j] - py;
+            float ndx = nextX[j] - nx;
+            float ndy = nextY[j] - ny;
+            float prev = pdx * pdx + pdy * pdy;
+            float next = ndx * ndx + ndy * ndy;
+            
+            if (prev != 0 && next != 0) {
+                ratios[stored++] = next / prev;
+            }
+        }
+    }
+    
+    return stored;
+}
+
+
+int MedianFlow::sampleRatios(int count) {
+    int stored = 0;
+    
+    for (int k = 0; k < pairSamples; k++) {
+        // Pick two different points uniformly
+        int i = (int)(random() % count);
+        int j = (int)(random() % (count - 1));
+        
+        if (j >= i) {
+            j++;
+        }
+        
+        float pdx = prevX[j] - prevX[i];
+        float pdy = prevY[j] - prevY[i];
+        float ndx = nextX[j] - nextX[i];
+        float ndy = nextY[j] - nextY[i];
+        float prev = pdx * pdx + pdy * pdy;
+        float next = ndx * ndx + ndy * ndy;
+        
+        if (prev != 0 && next != 0) {
+            ratios[stored++] = next / prev;
+        }
+    }
+    
+    return stored;
+}
+
+
+void MedianFlow::middle(float *A, int length, float *lower, float *upper) {
+    int index = length / 2;
+    
+    if (length % 2 == 1) {
+        std::nth_element(A, A + index, A + length);
+        *lower = A[index];
+        *upper = A[index];
+    } else {
+        // Everything after the lower middle value is at least as large, so
+        // the upper middle value is the smallest of them
+        std::nth_element(A, A + index - 1, A + length);
+        *lower = A[index - 1];
+        *upper = *std::min_element(A + index, A + length);
+    }
+}
+
+
+float MedianFlow::median(float *A, int length) {
+    if (length == 0) {
+        return 0;
+    }
+    
+    float lower, upper;
+    middle(A, length, &lower, &upper);
+    return (lower + upper) / 2;
+}
+
+
+bool MedianFlow::estimate(const cv::Point2f *prevPoints, const cv::Point2f *nextPoints, const uchar *status, int count, double *dispX, double *dispY, double *scale) {
+    // Gather the successfully tracked points
+    int tracked = 0;
+    
+    for (int i = 0; i < count; i++) {
+        if (status[i] == 1) {
+            prevX[tracked] = prevPoints[i].x;
+            prevY[tracked] = prevPoints[i].y;
+            nextX[tracked] = nextPoints[i].x;
+            nextY[tracked] = nextPoints[i].y;
+            dxs[tracked] = nextPoints[i].x - prevPoints[i].x;
+            dys[tracked] = nextPoints[i].y - prevPoints[i].y;
+            tracked++;
+        }
+    }
+    
+    if (tracked == 0) {
+        return false;
+    }
+    
+    *dispX = (double)median(dxs, tracked);
+    *dispY = (double)median(dys, tracked);
+    
+    // The median of the squared ratios comes from the same pairs as the
+    // median of the ratios, so only those two are square rooted
+    int pairs = tracked * (tracked - 1) / 2;
+    int comparisons = pairSamples > 0 && pairs > pairSamples ? sampleRatios(tracked) : allRatios(tracked);
+    
+    if (comparisons == 0) {
+        *scale = 1;
+    } else {
+        float lower, upper;
+        middle(ratios, comparisons, &lower, &upper);
+        *scale = (sqrt((double)lower) + sqrt((double)upper)) / 2;
+    }
+    
+    return true;
+}
+
+
+MedianFlow::~MedianFlow() {
+    free(prevX);
+    free(prevY);
+    free(nextX);
+    free(nextY);
+    free(dxs);
+    free(dys);
+    free(ratios);
+}
@@ -0,0 +1,110 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "opencv2/core/core.hpp"
+
+
+/*  Estimates the motion of a bounding-box from the points tracked in it, as
+    the median displacement of the points in each dimension and the median
+    change in distance between pairs of points.
+    
+    Medians are found by selection (std::nth_element) rather than sorting,
+    so estimating takes time linear in the number of points and pairs. The
+    distance ratios of pairs are compared squared, which preserves their
+    order, so only the two ratios the median comes from are square rooted,
+    and are computed several pairs at a time with SIMD (see Simd.h).
+    
+    The number of pairs grows quadratically with the number of points, so
+    beyond a given number of pairs, a random sample of them is used instead.
+    By Hoeffding's inequality, the median of n pairs sampled uniformly lies
+    between the 45th and 55th percentiles of the ratios of all pairs with
+    probability at least 1 - 2exp(-n / 200), e.g. about 98.8% for n = 1024,
+    and 99% from n = 1060. Sampled pairs of points at the same position have
+    no ratio and are skipped, so n is the number of pairs whose ratio was
+    used, which can be fewer than the number sampled.
+    
+    All scratch space is allocated on construction, so estimating doesn't
+    allocate. */
+class MedianFlow {
+    // Private ===============================================================
+    private:
+    // Maximum number of points and number of pairs sampled, or 0 to use
+    // every pair
+    int maxPoints;
+    int pairSamples;
+    
+    // Coordinates of the successfully tracked points in the previous and
+    // next frames
+    float *prevX;
+    float *prevY;
+    float *nextX;
+    float *nextY;
+    
+    // Displacement of each successfully tracked point in each dimension
+    float *dxs;
+    float *dys;
+    
+    // Squared distance ratio of each pair of points used
+    float *ratios;
+    
+    // State of the random number generator used to sample pairs
+    unsigned int seed;
+    
+    /*  Computes the squared distance ratio of every pair of the tracked
+        points whose distance is non-zero in both frames.
+        Returns the number of ratios stored.
+        count: number of tracked points */
+    int allRatios(int count);
+    
+    /*  Computes the squared distance ratio of pairSamples random pairs of
+        the tracked points, skipping pairs whose distance is zero in either
+        frame.
+        Returns the number of ratios stored.
+        count: number of tracked points */
+    int sampleRatios(int count);
+    
+    /*  Returns the next value of the random number generator. */
+    unsigned int random(void);
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        maxPoints: maximum number of points estimated from
+        pairSamples: number of pairs to sample once there are more pairs
+            than this, or 0 to always use every pair */
+    MedianFlow(int maxPoints, int pairSamples);
+    
+    /*  Finds the two middle values of an array; they are equal if its length
+        is odd. Reorders the array.
+        A: the array
+        length: length of array A, at least 1
+        lower: set to the lower middle value
+        upper: set to the upper middle value */
+    static void middle(float *A, int length, float *lower, float *upper);
+    
+    /*  Returns the median of an array of float values, or 0 if it is empty.
+        Reorders the array.
+        A: the array
+        length: length of array A */
+    static float median(float *A, int length);
+    
+    /*  Estimates the motion of the points tracked successfully.
+        Returns true on success, false if no point was tracked.
+        prevPoints: the points in the previous frame
+        nextPoints: the points tracked to the next frame
+        status: 1 for each point tracked successfully, otherwise 0
+        count: number of points, at most maxPoints
+        dispX: set to the median displacement in x
+        dispY: set to the median displacement in y
+        scale: set to the median ratio of the distances between pairs of
+            points in the next and previous frames, or 1 if there are too
+            few points */
+    bool estimate(const cv::Point2f *prevPoints, const cv::Point2f *nextPoints, const uchar *status, int count, double *dispX, double *dispY, double *scale);
+    
+    /*  Destructor. */
+    ~MedianFlow(void);
+};
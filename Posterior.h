@@ -0,0 +1,63 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include <stdint.h>
+
+
+/*  Selects how fern posterior likelihoods are stored. By default they are
+    floats. Defining TLD_POSTERIOR_BITS as 8 or 16 (e.g. -DTLD_POSTERIOR_BITS=8)
+    stores them as fixed-point values instead, scaled so POSTERIOR_ONE is a
+    likelihood of 1, and sums the ferns' posteriors in integers.
+    
+    Posterior: type of a stored posterior likelihood
+    PosteriorSum: type of the sum of the posteriors of all ferns
+    POSTERIOR_ONE: stored value of a likelihood of 1
+    
+    Tolerance: each posterior is rounded to the nearest 1 / POSTERIOR_ONE, so
+    a classifier confidence (the mean over the ferns) differs from the float
+    confidence by at most 0.5 / POSTERIOR_ONE, i.e. 0.00196 with 8 bits and
+    0.0000077 with 16 bits. Accept/reject decisions against a threshold are
+    therefore the same as with floats for every patch whose float confidence
+    is further than that from the threshold.
+    
+    With 10 ferns of 5 two-bit nodes, the float posteriors take 40KB and the
+    8-bit ones 10KB, so the whole table fits in L1 cache. */
+#if defined(TLD_POSTERIOR_BITS) && TLD_POSTERIOR_BITS != 8 && TLD_POSTERIOR_BITS != 16
+    #error TLD_POSTERIOR_BITS MUST be 8 or 16
+#endif
+
+#if defined(TLD_POSTERIOR_BITS) && TLD_POSTERIOR_BITS == 8
+    typedef uint8_t Posterior;
+    typedef int PosteriorSum;
+    #define POSTERIOR_ONE 255
+#elif defined(TLD_POSTERIOR_BITS) && TLD_POSTERIOR_BITS == 16
+    typedef uint16_t Posterior;
+    typedef int PosteriorSum;
+    #define POSTERIOR_ONE 65535
+#else
+    typedef float Posterior;
+    typedef float PosteriorSum;
+    #define POSTERIOR_ONE 1.0f
+#endif
+
+
+/*  Converts a likelihood to its stored value, rounding to the nearest.
+    likelihood: likelihood between 0 and 1 */
+inline Posterior posteriorFromLikelihood(float likelihood) {
+#if defined(TLD_POSTERIOR_BITS) && (TLD_POSTERIOR_BITS == 8 || TLD_POSTERIOR_BITS == 16)
+    return (Posterior)(likelihood * POSTERIOR_ONE + 0.5f);
+#else
+    return likelihood;
+#endif
+}
+
+
+/*  Converts the sum of several posteriors to their mean likelihood.
+    sum: sum of the posteriors
+    count: number of posteriors summed */
+inline float posteriorMean(PosteriorSum sum, int count) {
+    return (float)sum / ((float)count * POSTERIOR_ONE);
+}
@@ -0,0 +1,81 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "PyramidCache.h"
+#ifndef TLD_LEGACY_TRACKER
+#include "opencv2/video/tracking.hpp"
+#endif
+
+
+PyramidCache::PyramidCache(int slots, cv::Size windowSize, int maxLevel) {
+    this->windowSize = windowSize;
+    slotCount = slots;
+    frames.assign(slots, (const IplImage *)NULL);
+    pyramids.resize(slots);
+    levels.assign(slots, -1);
+    
+    // Each pyramid holds an image and its derivatives per level
+    for (int i = 0; i < slots; i++) {
+        pyramids[i].reserve(2 * (maxLevel + 1));
+    }
+    
+    lastUsed.assign(slots, 0);
+    uses = 0;
+}
+
+
+const vector<cv::Mat> &PyramidCache::get(const IplImage *frame, int level) {
+    int slot = -1;
+    uses++;
+    
+    // Use the frame's own slot if it has one, rebuilding its pyramid if it
+    // isn't deep enough
+    for (int i = 0; i < slotCount; i++) {
+        if (frames[i] == frame) {
+            slot = i;
+            break;
+        }
+    }
+    
+    if (slot >= 0 && levels[slot] >= level) {
+        lastUsed[slot] = uses;
+        return pyramids[slot];
+    }
+    
+    // Otherwise build the pyramid in a free slot, or the least recently used
+    for (int i = 0; slot < 0 && i < slotCount; i++) {
+        if (frames[i] == NULL) {
+            slot = i;
+        }
+    }
+    
+    if (slot < 0) {
+        slot = 0;
+        
+        for (int i = 1; i < slotCount; i++) {
+            if (lastUsed[i] < lastUsed[slot]) {
+                slot = i;
+            }
+        }
+    }
+    
+#ifndef TLD_LEGACY_TRACKER
+    cv::buildOpticalFlowPyramid(cv::cvarrToMat(frame), pyramids[slot], windowSize, level);
+#endif
+    frames[slot] = frame;
+    levels[slot] = level;
+    lastUsed[slot] = uses;
+    return pyramids[slot];
+}
+
+
+void PyramidCache::invalidate(const IplImage *frame) {
+    for (int i = 0; i < slotCount; i++) {
+        if (frames[i] == frame) {
+            frames[i] = NULL;
+        }
+    }
+}
+
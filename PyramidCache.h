@@ -0,0 +1,69 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "opencv2/core/core_c.h"
+#include "opencv2/core/core.hpp"
+#include <vector>
+
+using namespace std;
+
+
+/*  Holds the optical flow pyramids (see cv::buildOpticalFlowPyramid) of the
+    frames of one stream, so each frame's pyramid is built once and shared by
+    everything tracking to or from it: the forward and backward passes of the
+    Tracker, and any other trackers on the stream.
+    
+    Pyramids are keyed by the frame they were built from, so there is one
+    slot per frame of the session's FramePool. As the pool reuses its
+    frames, the session MUST invalidate a frame's pyramid whenever the frame
+    is overwritten. A pyramid is built when it is first asked for, only as
+    deep as asked for, so frames that are never tracked cost nothing and
+    shallow tracking builds shallow pyramids. A held pyramid that isn't deep
+    enough is rebuilt deeper.
+    
+    The pyramid Mats are reused once allocated, so building pyramids doesn't
+    allocate once each slot has been built into. Not thread-safe: a cache
+    MUST only be used by one thread at a time. Unused if
+    TLD_LEGACY_TRACKER. */
+class PyramidCache {
+    // Private ===============================================================
+    private:
+    // Largest search window size the pyramids are used with
+    cv::Size windowSize;
+    
+    // Number of slots, the frame each slot's pyramid was built from, or NULL
+    // if it holds none, the pyramids and their maximal level numbers
+    int slotCount;
+    vector<const IplImage *> frames;
+    vector<vector<cv::Mat> > pyramids;
+    vector<int> levels;
+    
+    // When each slot was last used, counted in calls to get, so the least
+    // recently used slot can be replaced if every slot is taken
+    vector<unsigned long> lastUsed;
+    unsigned long uses;
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        slots: number of frames whose pyramids are held at once
+        windowSize: largest search window size the pyramids are used with
+        maxLevel: largest maximal pyramid level number asked for */
+    PyramidCache(int slots, cv::Size windowSize, int maxLevel);
+    
+    /*  Returns the pyramid of a frame, building it if it isn't held at
+        least as deep as asked for. The pyramid is valid until the frame is
+        invalidated or its pyramid is next asked for.
+        frame: the frame
+        level: maximal pyramid level number needed, 0 for a single level */
+    const vector<cv::Mat> &get(const IplImage *frame, int level);
+    
+    /*  Discards the pyramid of a frame, if held, because the frame's pixels
+        have changed.
+        frame: the frame */
+    void invalidate(const IplImage *frame);
+};
@@ -0,0 +1,55 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "RawVideoFile.h"
+
+
+RawVideoFile::RawVideoFile(const char *path, int frameWidth, int frameHeight) {
+    this->frameWidth = frameWidth;
+    this->frameHeight = frameHeight;
+    frame = new uint8_t[frameWidth * frameHeight];
+    frameCount = 0;
+    file = fopen(path, "rb");
+    
+    if (file == NULL) {
+        printf("ERROR: COULD NOT OPEN %s!\n", path);
+    }
+}
+
+
+bool RawVideoFile::isOpen() {
+    return file != NULL;
+}
+
+
+const uint8_t *RawVideoFile::read() {
+    if (file == NULL) {
+        return NULL;
+    }
+    
+    // A partial frame at the end of the file is ignored
+    size_t size = (size_t)frameWidth * frameHeight;
+    
+    if (fread(frame, 1, size, file) != size) {
+        return NULL;
+    }
+    
+    frameCount++;
+    return frame;
+}
+
+
+int RawVideoFile::getFrameCount() {
+    return frameCount;
+}
+
+
+RawVideoFile::~RawVideoFile() {
+    if (file != NULL) {
+        fclose(file);
+    }
+    
+    delete [] frame;
+}
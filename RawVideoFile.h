@@ -0,0 +1,57 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+
+/*  Reads the frames of a raw video file one at a time, as an offline source
+    of frames for a TLDEngine or TLDSession.
+    
+    The file holds nothing but 8-bit greyscale frames of a known size, one
+    after another, each stored row by row, as written by e.g.
+    ffmpeg -i video -f rawvideo -pix_fmt gray video.raw
+    Frames are read into one buffer allocated on construction, so reading
+    doesn't allocate. */
+class RawVideoFile {
+    // Private ===============================================================
+    private:
+    // The open file, or NULL
+    FILE *file;
+    
+    // Size of each frame
+    int frameWidth;
+    int frameHeight;
+    
+    // The most recently read frame
+    uint8_t *frame;
+    
+    // Number of frames read so far
+    int frameCount;
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor. Opens the file; check isOpen before reading.
+        path: path of the file
+        frameWidth: width of each frame
+        frameHeight: height of each frame */
+    RawVideoFile(const char *path, int frameWidth, int frameHeight);
+    
+    /*  Returns true if the file was opened. */
+    bool isOpen(void);
+    
+    /*  Reads the next frame. Pixel (x, y) is at frame[y * width + x].
+        Returns the frame, valid until the next read, or NULL once every
+        complete frame has been read. */
+    const uint8_t *read(void);
+    
+    /*  Returns the number of frames read so far. */
+    int getFrameCount(void);
+    
+    /*  Destructor. Closes the file. */
+    ~RawVideoFile(void);
+};
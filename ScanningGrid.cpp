@@ -0,0 +1,196 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "ScanningGrid.h"
+
+
+ScanningGrid::ScanningGrid(int frameWidth, int frameHeight, int stride, Classifier *classifier) {
+    this->frameWidth = frameWidth;
+    this->frameHeight = frameHeight;
+    this->stride = stride;
+    this->classifier = classifier;
+    baseWidth = -1;
+    baseHeight = -1;
+    positions = -1;
+    offsetCount = classifier->getOffsetCount();
+    scaleWidths = new int[SCAN_SCALES];
+    scaleHeights = new int[SCAN_SCALES];
+    scaleOffsets = new int[SCAN_SCALES * offsetCount];
+    bands = new ScanningBand[MAX_BANDS];
+    windowXs = new int[MAX_WINDOWS];
+    windowYs = new int[MAX_WINDOWS];
+    windowOffsets = new int[MAX_WINDOWS];
+    scaleCount = 0;
+    bandCount = 0;
+    windowCount = 0;
+}
+
+
+void ScanningGrid::build(int baseWidth, int baseHeight, int positions) {
+    this->baseWidth = baseWidth;
+    this->baseHeight = baseHeight;
+    this->positions = positions;
+    scaleCount = 0;
+    bandCount = 0;
+    windowCount = 0;
+    
+    // The amount to increment scale by each iteration
+    float scaleInc = (SCAN_MAX_SCALE - SCAN_MIN_SCALE) / (SCAN_SCALES - 1);
+    
+    // Loop through a range of bounding-box scales
+    for (float scale = SCAN_MIN_SCALE; scale <= SCAN_MAX_SCALE && scaleCount < SCAN_SCALES; scale += scaleInc) {
+        int minX = 0;
+        int currentWidth = (int)(scale * (float)baseWidth);
+        int maxX = frameWidth - currentWidth;
+        int incX = (maxX - minX) / (positions - 1);
+        
+        // If bounding-box width >= frame width, make only 1 iteration of the
+        // x-position loop
+        if (incX <= 0) {
+            maxX = 0;
+            incX = 1;
+        }
+        
+        // Same for y
+        int minY = 0;
+        int currentHeight = (int)(scale * (float)baseHeight);
+        int maxY = frameHeight - currentHeight;
+        int incY = (maxY - minY) / (positions - 1);
+        
+        if (incY <= 0) {
+            maxY = 0;
+            incY = 1;
+        }
+        
+        // Precompute the feature offsets for this window size. Windows are
+        // limited to the frame just as in Fern::getLeafIndex, which only
+        // affects windows larger than the frame
+        scaleWidths[scaleCount] = currentWidth;
+        scaleHeights[scaleCount] = currentHeight;
+        classifier->getOffsets(std::min(currentWidth, frameWidth), std::min(currentHeight, frameHeight), stride, scaleOffsets + scaleCount * offsetCount);
+        
+        // Add a band for each bounding-box top-left x-position, containing a
+        // window for each top-left y-position
+        for (int x = minX; x <= maxX; x += incX) {
+            ScanningBand *band = &bands[bandCount++];
+            band->scale = scaleCount;
+            band->first = windowCount;
+            
+            for (int y = minY; y <= maxY; y += incY) {
+                windowXs[windowCount] = x;
+                windowYs[windowCount] = y;
+                windowOffsets[windowCount] = y * stride + x;
+                windowCount++;
+            }
+            
+            band->count = windowCount - band->first;
+        }
+        
+        scaleCount++;
+    }
+}
+
+
+bool ScanningGrid::matches(int baseWidth, int baseHeight, int positions) {
+    return this->baseWidth == baseWidth && this->baseHeight == baseHeight && this->positions == positions;
+}
+
+
+int ScanningGrid::getBandCount() {
+    return bandCount;
+}
+
+
+ScanningBand *ScanningGrid::getBand(int index) {
+    return &bands[index];
+}
+
+
+int ScanningGrid::getWindowCount() {
+    return windowCount;
+}
+
+
+int *ScanningGrid::getWindowXs() {
+    return windowXs;
+}
+
+
+int *ScanningGrid::getWindowYs() {
+    return windowYs;
+}
+
+
+int *ScanningGrid::getWindowOffsets() {
+    return windowOffsets;
+}
+
+
+int ScanningGrid::getScaleWidth(int scale) {
+    return scaleWidths[scale];
+}
+
+
+int ScanningGrid::getScaleHeight(int scale) {
+    return scaleHeights[scale];
+}
+
+
+int *ScanningGrid::getScaleOffsets(int scale) {
+    return scaleOffsets + scale * offsetCount;
+}
+
+
+ScanningGrid::~ScanningGrid() {
+    delete [] scaleWidths;
+    delete [] scaleHeights;
+    delete [] scaleOffsets;
+    delete [] bands;
+    delete [] windowXs;
+    delete [] windowYs;
+    delete [] windowOffsets;
+}
+
+
+ScanningGridCache::ScanningGridCache(int frameWidth, int frameHeight, int stride, Classifier *classifier) {
+    clock = 0;
+    
+    for (int i = 0; i < GRID_CACHE_SIZE; i++) {
+        grids[i] = new ScanningGrid(frameWidth, frameHeight, stride, classifier);
+        lastUsed[i] = 0;
+    }
+}
+
+
+ScanningGrid *ScanningGridCache::get(int baseWidth, int baseHeight, int positions) {
+    clock++;
+    
+    // Look for the grid, noting the least recently used (or an unused) grid
+    int oldest = 0;
+    
+    for (int i = 0; i < GRID_CACHE_SIZE; i++) {
+        if (lastUsed[i] > 0 && grids[i]->matches(baseWidth, baseHeight, positions)) {
+            lastUsed[i] = clock;
+            return grids[i];
+        }
+        
+        if (lastUsed[i] < lastUsed[oldest]) {
+            oldest = i;
+        }
+    }
+    
+    // Not cached; rebuild the least recently used grid
+    grids[oldest]->build(baseWidth, baseHeight, positions);
+    lastUsed[oldest] = clock;
+    
+    return grids[oldest];
+}
+
+
+ScanningGridCache::~ScanningGridCache() {
+    for (int i = 0; i < GRID_CACHE_SIZE; i++) {
+        delete grids[i];
+    }
+}
@@ -0,0 +1,187 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "Classifier.h"
+
+
+// Constants -----------------------------------------------------------------
+// Number of bounding-box scales scanned by the sliding window
+#define SCAN_SCALES 6
+
+// Minimum and maximum bounding-box scales scanned, relative to the base
+// bounding-box size
+#define SCAN_MIN_SCALE 0.5f
+#define SCAN_MAX_SCALE 1.5f
+
+// Number of bounding-box positions scanned in each dimension, where space
+// allows
+#define SCAN_POSITIONS 30
+
+// Number of bounding-box positions scanned in each dimension by a sparse
+// grid, scanned when frames are over budget (see FrameScheduler)
+#define SPARSE_SCAN_POSITIONS 15
+
+// Maximum number of positions actually scanned in each dimension. Position
+// increments are rounded down, so up to twice SCAN_POSITIONS - 1 positions
+// can be scanned when the increment is rounded down to 1
+#define MAX_SCAN_POSITIONS (2 * (SCAN_POSITIONS - 1))
+
+// Maximum number of windows in a grid
+#define MAX_WINDOWS (SCAN_SCALES * MAX_SCAN_POSITIONS * MAX_SCAN_POSITIONS)
+
+// Maximum number of bands in a grid
+#define MAX_BANDS (SCAN_SCALES * MAX_SCAN_POSITIONS)
+
+// Number of grids kept by a ScanningGridCache
+#define GRID_CACHE_SIZE 4
+
+
+/*  A band of sliding windows sharing a scale and top-left x-position, i.e. a
+    column of windows. Bands are the unit of work scanned in parallel. */
+struct ScanningBand {
+    // Index of the scale of the windows
+    int scale;
+    
+    // Index of the first window of this band; the band's windows are
+    // consecutive
+    int first;
+    
+    // Number of windows in this band
+    int count;
+};
+
+
+/*  The lattice of sliding windows scanned by the Detector for one frame size
+    and base bounding-box size.
+    
+    Besides each window's position, the grid holds, for every scale, the
+    integral image offsets of every feature node of every fern (see
+    Classifier::getOffsets), so that classifying a window involves only
+    integer table lookups relative to the window's top-left element.
+    
+    Windows are ordered by scale, then x-position, then y-position, and
+    grouped into bands (see ScanningBand).
+    
+    All memory is allocated on construction for the largest possible grid,
+    so a grid can be rebuilt for another base size without allocating. */
+class ScanningGrid {
+    // Private ===============================================================
+    private:
+    // Size of the frames, stride of their integral images and base
+    // bounding-box size and number of positions this grid was built for (-1
+    // if not built)
+    int frameWidth, frameHeight, stride;
+    int baseWidth, baseHeight, positions;
+    
+    // Classifier the windows are classified with
+    Classifier *classifier;
+    
+    // Number of scales, the window size at each scale and the classifier
+    // offsets at each scale (scaleCount * offsetCount elements)
+    int scaleCount;
+    int *scaleWidths;
+    int *scaleHeights;
+    int *scaleOffsets;
+    int offsetCount;
+    
+    // Bands of windows
+    int bandCount;
+    ScanningBand *bands;
+    
+    // Top-left position of each window and its offset in the integral image
+    int windowCount;
+    int *windowXs;
+    int *windowYs;
+    int *windowOffsets;
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor. Creates an empty grid.
+        frameWidth: width of the video stream frames
+        frameHeight: height of the video stream frames
+        stride: stride of the frames' integral images
+        classifier: classifier the windows are classified with */
+    ScanningGrid(int frameWidth, int frameHeight, int stride, Classifier *classifier);
+    
+    /*  (Re)builds the grid for the given base bounding-box size.
+        baseWidth: bounding-box width at scale 1
+        baseHeight: bounding-box height at scale 1
+        positions: number of positions to scan in each dimension, where space
+            allows; at most SCAN_POSITIONS */
+    void build(int baseWidth, int baseHeight, int positions);
+    
+    /*  Returns whether this grid was built for the given base bounding-box
+        size and number of positions.
+        baseWidth: bounding-box width at scale 1
+        baseHeight: bounding-box height at scale 1
+        positions: number of positions in each dimension */
+    bool matches(int baseWidth, int baseHeight, int positions);
+    
+    /*  Getter for bandCount. */
+    int getBandCount(void);
+    
+    /*  Returns the band with the given index. */
+    ScanningBand *getBand(int index);
+    
+    /*  Getter for windowCount. */
+    int getWindowCount(void);
+    
+    /*  Getters for the window positions and integral image offsets. */
+    int *getWindowXs(void);
+    int *getWindowYs(void);
+    int *getWindowOffsets(void);
+    
+    /*  Returns the window width at the given scale. */
+    int getScaleWidth(int scale);
+    
+    /*  Returns the window height at the given scale. */
+    int getScaleHeight(int scale);
+    
+    /*  Returns the classifier offsets at the given scale. */
+    int *getScaleOffsets(int scale);
+    
+    /*  Destructor. */
+    ~ScanningGrid(void);
+};
+
+
+/*  A least-recently-used cache of ScanningGrids for one frame size. While
+    the tracked bounding-box size is stable, its grid is built once and
+    reused every frame. On a miss, the least recently used grid is rebuilt in
+    place, so the cache never allocates after construction. */
+class ScanningGridCache {
+    // Private ===============================================================
+    private:
+    // Cached grids and the time each was last used (0 if never)
+    ScanningGrid *grids[GRID_CACHE_SIZE];
+    unsigned long lastUsed[GRID_CACHE_SIZE];
+    
+    // Incremented on every lookup
+    unsigned long clock;
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        frameWidth: width of the video stream frames
+        frameHeight: height of the video stream frames
+        stride: stride of the frames' integral images
+        classifier: classifier the windows are classified with */
+    ScanningGridCache(int frameWidth, int frameHeight, int stride, Classifier *classifier);
+    
+    /*  Returns the grid for the given base bounding-box size and number of
+        positions, building it and evicting the least recently used grid if
+        it isn't cached.
+        baseWidth: bounding-box width at scale 1
+        baseHeight: bounding-box height at scale 1
+        positions: number of positions to scan in each dimension; at most
+            SCAN_POSITIONS */
+    ScanningGrid *get(int baseWidth, int baseHeight, int positions);
+    
+    /*  Destructor. */
+    ~ScanningGridCache(void);
+};
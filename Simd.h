@@ -0,0 +1,25 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+
+
+/*  Selects the widest SIMD instruction set enabled by the compiler and
+    includes its intrinsics. Exactly one of the following is defined:
+        TLD_AVX2: AVX2 is available (e.g. -mavx2 or /arch:AVX2)
+        TLD_SSE2: SSE2 is available (always the case on x86-64)
+        TLD_SCALAR: neither is available; scalar fallbacks are used
+    
+    Code using these macros MUST provide a scalar path, and the SIMD paths
+    MUST produce bit-exact results to it. */
+#if defined(__AVX2__)
+    #define TLD_AVX2
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TLD_SSE2
+    #include <emmintrin.h>
+#else
+    #define TLD_SCALAR
+#endif
@@ -3,203 +3,58 @@
     terms of the GNU General Public License as published by the Free Software
     Foundation. This software is provided without warranty of ANY kind. */
 
-#include "cv.h"
-#include "highgui.h"
-#include "Detector.h"
-#include "Classifier.h"
-#include "Tracker.h"
-#include <math.h>
-#include <vector>
+#include "mex.h"
+#include "AllocationCounter.h"
+#include "TLDSession.h"
 
 
 /// Globals ==================================================================
-// Constants -----------------------------------------------------------------
-// Number of ferns in the classifier
-#define TOTAL_FERNS 10
-
-// Number of nodes per fern
-#define TOTAL_NODES 5
-
-// Minimum percentage of patch width and height a feature can take
-#define MIN_FEATURE_SCALE 0.1f
-
-// Maximum percentage of patch width and height a feature can take
-#define MAX_FEATURE_SCALE 0.5f
-
-// Minimum confidence of the previous frame trajectory patch for us to learn
-// this frame
-#define MIN_LEARNING_CONF 0.8
-
-// When a detected patch has higher confidence than the tracked patch, it must
-// still have higher confidence than this for us to reinitialise
-// Note: Should be <= MIN_LEARNING_CONF
-#define MIN_REINIT_CONF 0.8
-
-// Minimum confidence of the tracked patch in the previous frame for us to
-// track in the next frame
-#define MIN_TRACKING_CONF 0.1
-
-
 // Variables -----------------------------------------------------------------
-// Our classifier, tracker and detector
-static Classifier *classifier;
-static Tracker *tracker;
-static Detector *detector;
-
-// Lets us know whether TLD has been initialised or not
-static bool initialised = false;
-
-// Initial size of the bounding-box
-static float initBBWidth;
-static float initBBHeight;
-
-// Size of each frame
-int frameWidth;
-int frameHeight;
-CvSize *frameSize;
-
-// Confidence of the previous frame's trajectory patch
-double confidence;
+// The session driven from Matlab, or NULL if not initialised
+static TLDSession *session = NULL;
 
 
 
 /// Methods ==================================================================
-/*  Converts an image received from Matlab to an IplImage.
-    Returns: the converted image.
-    mxImage: the image straight from Matlab */
-IplImage *imageFromMatlab(const mxArray *mxImage) {
-    // Get pointer
-    unsigned char *values = (unsigned char *)mxGetPr(mxImage);
-    
-    // Create our return image
-    IplImage *image = cvCreateImage(*frameSize, IPL_DEPTH_8U, 1);
-    
-    // Loop through the new image getting values from the old one
-    // Note: values are effectively rotated 90 degrees
-    for (int i = 0; i < frameWidth; i++) {
-        for (int j = 0; j < frameHeight; j++) {
-            image->imageData[j * frameWidth + i] = values[i * frameHeight + j];
-        }
-    }
-    
-    return image;
-}
-
-
-/*  Trains the classifier on warps of a bounding-box patch.
-    frame: frame to take warps from
-    bb: first-frame bounding-box [x, y, width, height] */
-void bbWarpPatch(IntegralImage *frame, double *bb) {
-    // Transformation matrix
-    float *m = new float[4];
-    
-    // Loop through various rotations and skews
-    for (float r = -0.1f; r < 0.1f; r += 0.005f) {
-        float sine = sin(r);
-        float cosine = cos(r);
-        
-        for (float sx = -0.1f; sx < 0.1f; sx += 0.05f) {
-            for (float sy = -0.1f; sy < 0.1f; sy += 0.05f) {
-                // Set transformation
-                /*  Rotation matrix * skew matrix =
-                    
-                    | cos r   sin r | * | 1   sx | = 
-                    | -sin r  cos r |   | sy   1 |
-                    
-                    | cos r + sy * sin r   sx * cos r + sin r |
-                    | sy * cos r - sin r   cos r - sx * sin r | */
-                m[0] = cosine + sy * sine;
-                m[1] = sx * cosine + sine;
-                m[2] = sy * cosine - sine;
-                m[3] = cosine - sx * sine;
-                
-                // Create warp and train classifier
-                IntegralImage *warp = new IntegralImage();
-                warp->createWarp(frame, bb, m);
-                classifier->train(warp, 0, 0, (int)bb[2], (int)bb[3], 1);
-                delete warp;
-            }
-        }
-    }
-    
-    delete m;
-}
-
-
-/*  Trains the classifier on negative training patches, i.e. patches from the
-    first frame that don't overlap the bounding-box patch.
-    frame: frame to take warps from
-    tbb: first-frame bounding-box [x, y, width, height] */
-void trainNegative(IntegralImage *frame, double *tbb) {
-    // Minimum and maximum scales for the bounding-box, the number of scale
-    // iterations to make, and the amount to increment scale by each iteration
-    float minScale = 0.5f;
-    float maxScale = 1.5f;
-    int iterationsScale = 5;
-    float scaleInc = (maxScale - minScale) / (iterationsScale - 1);
-    
-    // Loop through a range of bounding-box scales
-    for (float scale = minScale; scale <= maxScale; scale += scaleInc) {
-        int minX = 0;
-        int currentWidth = (int)(scale * initBBWidth);
-        int maxX = frameWidth - currentWidth;
-        int iterationsX = 20;
-        int incX = (maxX - minX) / (iterationsX - 1);
-        
-        // If bounding-box width >= frame width, make only 1 iteration of the
-        // following for loop
-        if (incX <= 0) {
-            maxX = 0;
-            incX = 1;
-        }
-        
-        // Loop through all bounding-box top-left x-positions
-        for (int x = minX; x <= maxX; x += incX) {
-            // Same for y
-            int minY = 0;
-            int currentHeight = (int)(scale * initBBHeight);
-            int maxY = frameHeight - currentHeight;
-            int iterationsY = 20;
-            int incY = (maxY - minY) / (iterationsY - 1);
-            
-            // If bounding-box height >= frame height, make only 1 iteration
-            // of the following for loop
-            if (incY <= 0) {
-                maxY = 0;
-                incY = 1;
-            }
-            
-            // Loop through all bounding-box top-left x-positions
-            for (int y = minY; y <= maxY; y += incY) {
-                // Define the patch and test whether it's overlap with the
-                // first-frame patch is less than MIN_LEARNING_OVERLAP, if
-                // so, train as negative
-                double *bb = new double[4];
-                bb[0] = (double)x;
-                bb[1] = (double)y;
-                bb[2] = (double)currentWidth;
-                bb[3] = (double)currentHeight;
-                
-                if (Detector::bbOverlap(tbb, bb) < MIN_LEARNING_OVERLAP) {
-                    classifier->train(frame, x, y, currentWidth, currentHeight, 0);
-                } else {
-                    //classifier->train(frame, x, y, currentWidth, currentHeight, 1);
-                }
-                
-                delete [] bb;
-            }
-        }
+/*  Frees the session, if any, joining its threads, and unlocks the mex file.
+    Registered with mexAtExit, so no thread outlives the code it runs when
+    the mex file is cleared or Matlab exits. */
+static void freeSession(void) {
+    if (session != NULL) {
+        delete session;
+        session = NULL;
+        mexUnlock();
     }
 }
 
 
-/*  Entry point for mex.
+/*  Entry point for mex. A thin wrapper around a TLDSession, converting
+    between Matlab and it.
     Call form: [left, hand, side, outs] = Detector(right, hand, side, args)
     Either use:
     To initialise:
         TLD(frame width, frame height, first frame, selected bounding-box)
     To process a frame:
         new trajectory bounding-box = TLD(current frame, trajectory bounding-box)
+    or, to also get the number of heap allocations made processing the frame
+    (always 0 unless compiled with TLD_COUNT_ALLOCATIONS, see
+    AllocationCounter.h) and the number of windows handled by each detector
+    stage [windows, variance rejected, classifier rejected, accepted,
+    skipped] (see DetectorStats), all 0 if the detector didn't run, and the
+    level of quality the frame was processed at (see FrameScheduler), and
+    the tracker's [pyramid level, window half-size, expected displacement,
+    points tracked, points kept, Lucas-Kanade solves, maximum iterations,
+    whether the motion was predicted]
+    (see TrackerStats), all 0 if the tracker didn't run:
+        [new trajectory bounding-box, allocations, stages, level, tracker] =
+            TLD(current frame, trajectory bounding-box)
+    The trajectory bounding-box argument is the first row output for the
+    previous frame; the session keeps its own copy, so it is not read.
+    To free the session and its threads:
+        TLD()
+    The mex file is locked in memory while a session exists, as the
+    session's threads run its code, so free the session before clearing or
+    recompiling it.
     
     nlhs: number of left-hand side outputs
     plhs: the left-hand side outputs
@@ -209,159 +64,111 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
     // Initialisation --------------------------------------------------------
     if (nlhs == 0 && nrhs == 4) {
         // Get input
-        frameWidth = (int)*mxGetPr(prhs[0]);
-        frameHeight = (int)*mxGetPr(prhs[1]);
-        frameSize = (CvSize *)malloc(sizeof(CvSize));
-        *frameSize = cvSize(frameWidth, frameHeight);
-        IntegralImage *firstFrame = new IntegralImage();
-        firstFrame->createFromMatlab(prhs[2]);
-        IplImage *firstFrameIplImage = imageFromMatlab(prhs[2]);
-        double *bb = mxGetPr(prhs[3]);
-        initBBWidth = (float)bb[2];
-        initBBHeight = (float)bb[3];
-        confidence = 1.0f;
-        
-        // Initialise classifier, tracker and detector
-        srand((unsigned int)time(0));
-        classifier = new Classifier(TOTAL_FERNS, TOTAL_NODES, MIN_FEATURE_SCALE, MAX_FEATURE_SCALE);
-        tracker = new Tracker(frameWidth, frameHeight, frameSize, firstFrameIplImage, classifier);
-        detector = new Detector(frameWidth, frameHeight, bb, classifier);
+        int frameWidth = (int)*mxGetPr(prhs[0]);
+        int frameHeight = (int)*mxGetPr(prhs[1]);
         
-        // Train the classifier on the bounding-box patch and warps of it
-        classifier->train(firstFrame, (int)bb[0], (int)bb[1], (int)initBBWidth, (int)initBBHeight, 1);
-        bbWarpPatch(firstFrame, bb);
-        trainNegative(firstFrame, bb);
+        // Free any previous session, and make sure the session is freed
+        // before the mex file is unloaded
+        freeSession();
+        mexAtExit(freeSession);
+        session = new TLDSession(frameWidth, frameHeight, DETECTOR_THREADS, true);
         
-        // Free memory and set initialised
-        delete firstFrame;
-        initialised = true;
+        // Matlab images are stored column by column
+        if (!session->init((uint8_t *)mxGetPr(prhs[2]), frameHeight, 1, mxGetPr(prhs[3]))) {
+            delete session;
+            session = NULL;
+        } else {
+            // Keep the mex file loaded while the session's threads run
+            mexLock();
+        }
         
         return;
     }
     
     
+    // Release ---------------------------------------------------------------
+    if (nlhs == 0 && nrhs == 0) {
+        freeSession();
+        return;
+    }
+    
+    
     // Validate --------------------------------------------------------------
     // The remainder of this function handles the frame processing call
     // Ensure we get the correct call form Matlab and are initialised
-    if (!initialised || nlhs != 1 || nrhs != 2) {
+    if (session == NULL || nlhs < 1 || nlhs > 5 || nrhs != 2) {
         // Error
         return;
     }
     
+    unsigned long allocations = getAllocationCount();
     
-    // Get Input -------------------------------------------------------------
-    // Current frame
-    IplImage *nextFrame = imageFromMatlab(prhs[0]);
-    IntegralImage *nextFrameIntImg = new IntegralImage();
-    nextFrameIntImg->createFromMatlab(prhs[0]);
-    
-    // Trajectory bounding-box [x, y, width, height]
-    double *bb = mxGetPr(prhs[1]);
-    
-    
-    // Track and Detect ------------------------------------------------------
-    // Only track if we were confident enough in the previous iteration
-    // The tracker handles the memory freeing of nextFrame from here on
-    double *tbb;
-    vector<double *> *dbbs;
-    
-    if (confidence > MIN_TRACKING_CONF) {
-        tbb = tracker->track(nextFrame, nextFrameIntImg, bb);
-        dbbs = detector->detect(nextFrameIntImg, tbb);
-    } else {
-        dbbs = detector->detect(nextFrameIntImg, NULL);
-        tracker->setPrevFrame(nextFrame);
-        tbb = new double[5];
-        tbb[0] = 0;
-        tbb[1] = 0;
-        tbb[2] = 0;
-        tbb[3] = 0;
-        tbb[4] = MIN_TRACKING_CONF;
-    }
-    
-    
-    // Learn -----------------------------------------------------------------
-    // Get greatest detected patch confidence
-    double dbbMaxConf = 0.0f;
-    int dbbMaxConfIndex = -1;
-    
-    for (int i = 0; i < dbbs->size(); i++) {
-        double dbbConf = dbbs->at(i)[4];
-        
-        if (dbbConf > dbbMaxConf) {
-            dbbMaxConf = dbbConf;
-            dbbMaxConfIndex = i;
-        }
-    }
-    
-    // Reset the tracker bounding-box if a detected patch had highest
-    // confidence and is more confident than MIN_REINIT_CONF
-    if (dbbMaxConf > tbb[4] && dbbMaxConf > MIN_REINIT_CONF) {
-        delete tbb;
-        tbb = new double[5];
-        double *dbb = dbbs->at(dbbMaxConfIndex);
-        tbb[0] = dbb[0];
-        tbb[1] = dbb[1];
-        tbb[2] = dbb[2];
-        tbb[3] = dbb[3];
-        tbb[4] = dbb[4];
-    }
-    
-    // Apply constraints if the tracked patch had the greatest confidence and
-    // we were confident enough last frame
-    else if (tbb[4] > dbbMaxConf && confidence > MIN_LEARNING_CONF) {
-        for (int i = 0; i < dbbs->size(); i++) {
-            // Train the classifier on positive (overlapping with tracked
-            // patch) and negative (classed as positive but non-overlapping)
-            // patches
-            double *dbb = dbbs->at(i);
-            
-            if (dbb[5] == 1) {
-                classifier->train(nextFrameIntImg, (int)dbb[0], (int)dbb[1], (int)dbb[2], (int)dbb[3], 1);
-            }
-            else if (dbb[5] == 0) {
-                classifier->train(nextFrameIntImg, (int)dbb[0], (int)dbb[1], (int)dbb[2], (int)dbb[3], 0);
-            }
-        }
-    }
     
-    // Set confidence for next iteration
-    confidence = tbb[4];
+    // Process ---------------------------------------------------------------
+    // The session tracks from the trajectory bounding-box it output last
+    // frame, which is what Matlab passes back in
+    TLDResult result = session->process((uint8_t *)mxGetPr(prhs[0]), session->getFrameHeight(), 1);
     
     
     // Set output ------------------------------------------------------------
     // We output a list of bounding-boxes; the first bounding-box defines the
-    // tracked patch, the rest are detected positive match patches.
+    // tracked patch, the rest are detected positive match patches, or the
+    // most confident patch of each cluster of them if CLUSTER_DETECTIONS.
     // Rows correspond to individual bounding boxes
     // Columns correspond to [x, y, width, height, confidence, overlapping]
-    int bbCount = (int)dbbs->size() + 1;
+    int bbCount = result.detectionCount + 1;
     plhs[0] = mxCreateDoubleMatrix(bbCount, 6, mxREAL);
     double *outputBBs = mxGetPr(plhs[0]);
     
     // Set the tracked bounding-box
-    outputBBs[0 * bbCount] = tbb[0];
-    outputBBs[1 * bbCount] = tbb[1];
-    outputBBs[2 * bbCount] = tbb[2];
-    outputBBs[3 * bbCount] = tbb[3];
-    outputBBs[4 * bbCount] = tbb[4];
+    outputBBs[0 * bbCount] = result.tbb[0];
+    outputBBs[1 * bbCount] = result.tbb[1];
+    outputBBs[2 * bbCount] = result.tbb[2];
+    outputBBs[3 * bbCount] = result.tbb[3];
+    outputBBs[4 * bbCount] = result.tbb[4];
     outputBBs[5 * bbCount] = 0;
     
-    // Set detected bounding-boxes
-    for (int i = 1; i < bbCount; i++) {
-        double *bb = dbbs->at(i - 1);
-        outputBBs[0 * bbCount + i] = bb[0];
-        outputBBs[1 * bbCount + i] = bb[1];
-        outputBBs[2 * bbCount + i] = bb[2];
-        outputBBs[3 * bbCount + i] = bb[3];
-        outputBBs[4 * bbCount + i] = bb[4];
-        outputBBs[5 * bbCount + i] = bb[5];
-        delete bb;
+    // Set detected bounding-boxes, a column at a time
+    if (result.detectionIndices != NULL) {
+        result.detections->writeColumns(outputBBs, bbCount, 1, result.detectionIndices, result.detectionCount);
+    } else {
+        result.detections->writeColumns(outputBBs, bbCount, 1);
+    }
+    
+    // Report the number of heap allocations made processing this frame
+    if (nlhs >= 2) {
+        plhs[1] = mxCreateDoubleScalar((double)(getAllocationCount() - allocations));
+    }
+    
+    // Report the number of windows handled by each detector stage
+    if (nlhs >= 3) {
+        plhs[2] = mxCreateDoubleMatrix(1, 5, mxREAL);
+        double *stages = mxGetPr(plhs[2]);
+        stages[0] = result.stats.windows;
+        stages[1] = result.stats.varianceRejected;
+        stages[2] = result.stats.classifierRejected;
+        stages[3] = result.stats.accepted;
+        stages[4] = result.stats.skipped;
+    }
+    
+    // Report the level of quality this frame was processed at
+    if (nlhs >= 4) {
+        plhs[3] = mxCreateDoubleScalar((double)result.level);
     }
     
-    // Free memory
-    free(tbb);
-    dbbs->clear();
-    delete nextFrameIntImg;
+    // Report the tracker's parameters and work this frame
+    if (nlhs == 5) {
+        plhs[4] = mxCreateDoubleMatrix(1, 8, mxREAL);
+        double *tracking = mxGetPr(plhs[4]);
+        tracking[0] = result.trackerStats.level;
+        tracking[1] = result.trackerStats.windowSize;
+        tracking[2] = result.trackerStats.expectedMotion;
+        tracking[3] = result.trackerStats.trackedPoints;
+        tracking[4] = result.trackerStats.reliablePoints;
+        tracking[5] = result.trackerStats.solves;
+        tracking[6] = result.trackerStats.maxIterations;
+        tracking[7] = result.trackerStats.predicted;
+    }
 }
 
 
@@ -0,0 +1,263 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "TLDEngine.h"
+#include <string.h>
+
+
+TLDEngine::TLDEngine(int threadNum, int queueCapacity) {
+    capacity = queueCapacity;
+    listener = NULL;
+    cursor = 0;
+    stopping = false;
+    
+    if (threadNum <= 0) {
+        threadNum = (int)thread::hardware_concurrency();
+    }
+    
+    if (threadNum <= 0) {
+        threadNum = 1;
+    }
+    
+    for (int i = 0; i < threadNum; i++) {
+        workers.push_back(thread(&TLDEngine::work, this));
+    }
+}
+
+
+void TLDEngine::setListener(TLDResultListener *listener) {
+    unique_lock<mutex> guard(lock);
+    this->listener = listener;
+}
+
+
+int TLDEngine::nextReady() {
+    int streamCount = (int)streams.size();
+    
+    for (int i = 0; i < streamCount; i++) {
+        int index = (cursor + i) % streamCount;
+        Stream *stream = streams[index];
+        
+        if (!stream->busy && stream->count > 0) {
+            cursor = (index + 1) % streamCount;
+            return index;
+        }
+    }
+    
+    return -1;
+}
+
+
+bool TLDEngine::isIdle() {
+    for (int i = 0; i < (int)streams.size(); i++) {
+        if (streams[i]->count > 0) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+
+void TLDEngine::work() {
+    while (true) {
+        int index;
+        Stream *stream;
+        uint8_t *frame;
+        unsigned long frameIndex;
+        
+        // Wait for a stream with a queued frame and claim it
+        {
+            unique_lock<mutex> guard(lock);
+            
+            while (!stopping && (index = nextReady()) < 0) {
+                wake.wait(guard);
+            }
+            
+            if (stopping) {
+                return;
+            }
+            
+            stream = streams[index];
+            stream->busy = true;
+            frame = stream->frames + stream->head * stream->frameWidth * stream->frameHeight;
+            frameIndex = stream->processed;
+        }
+        
+        // Process without holding the lock. The frame stays queued until it
+        // has been processed, so its slot isn't overwritten meanwhile
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        TLDResult result = stream->session->process(frame, 1, stream->frameWidth);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        
+        if (listener != NULL) {
+            listener->onResult(index, frameIndex, result);
+        }
+        
+        // Free the slot and the stream for the next worker
+        {
+            unique_lock<mutex> guard(lock);
+            stream->head = (stream->head + 1) % capacity;
+            stream->count--;
+            stream->processed++;
+            stream->processingMs += ms;
+            stream->busy = false;
+            space.notify_all();
+            
+            if (stream->count > 0) {
+                wake.notify_one();
+            } else if (isIdle()) {
+                idle.notify_all();
+            }
+        }
+    }
+}
+
+
+int TLDEngine::addStream(int frameWidth, int frameHeight, const uint8_t *pixels, int step, int stride, const double *bb) {
+    // Initialise the session before it is visible to the workers. It runs
+    // on the worker processing it alone, starting no threads of its own, as
+    // the workers already use every thread
+    TLDSession *session = new TLDSession(frameWidth, frameHeight, 1, false);
+    
+    if (!session->init(pixels, step, stride, bb)) {
+        delete session;
+        return -1;
+    }
+    
+    Stream *stream = new Stream;
+    stream->session = session;
+    stream->frameWidth = frameWidth;
+    stream->frameHeight = frameHeight;
+    stream->frames = new uint8_t[capacity * frameWidth * frameHeight];
+    stream->head = 0;
+    stream->count = 0;
+    stream->busy = false;
+    stream->submitted = 0;
+    stream->processed = 0;
+    stream->rejected = 0;
+    stream->processingMs = 0;
+    stream->added = chrono::steady_clock::now();
+    
+    unique_lock<mutex> guard(lock);
+    streams.push_back(stream);
+    return (int)streams.size() - 1;
+}
+
+
+bool TLDEngine::submit(int stream, const uint8_t *pixels, int step, int stride, bool wait) {
+    Stream *target;
+    int slot;
+    
+    // Reserve a slot, waiting for one if requested
+    {
+        unique_lock<mutex> guard(lock);
+        
+        if (stream < 0 || stream >= (int)streams.size()) {
+            printf("ERROR: NO SUCH STREAM %d!\n", stream);
+            return false;
+        }
+        
+        target = streams[stream];
+        
+        while (wait && !stopping && target->count == capacity) {
+            space.wait(guard);
+        }
+        
+        if (stopping || target->count == capacity) {
+            target->rejected++;
+            return false;
+        }
+        
+        slot = (target->head + target->count) % capacity;
+    }
+    
+    // Copy the frame row-major outside the lock. Only this thread submits to
+    // the stream and workers only read slots already counted, so nothing
+    // else touches the slot
+    int width = target->frameWidth;
+    uint8_t *frame = target->frames + slot * width * target->frameHeight;
+    
+    for (int y = 0; y < target->frameHeight; y++) {
+        uint8_t *row = frame + y * width;
+        const uint8_t *source = pixels + y * stride;
+        
+        if (step == 1) {
+            memcpy(row, source, width);
+        } else {
+            for (int x = 0; x < width; x++) {
+                row[x] = source[x * step];
+            }
+        }
+    }
+    
+    unique_lock<mutex> guard(lock);
+    target->count++;
+    target->submitted++;
+    wake.notify_one();
+    return true;
+}
+
+
+void TLDEngine::waitIdle() {
+    unique_lock<mutex> guard(lock);
+    
+    while (!isIdle()) {
+        idle.wait(guard);
+    }
+}
+
+
+TLDStreamStats TLDEngine::getStats(int stream) {
+    TLDStreamStats stats;
+    memset(&stats, 0, sizeof(stats));
+    unique_lock<mutex> guard(lock);
+    
+    if (stream < 0 || stream >= (int)streams.size()) {
+        return stats;
+    }
+    
+    Stream *source = streams[stream];
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - source->added).count();
+    stats.submitted = source->submitted;
+    stats.processed = source->processed;
+    stats.rejected = source->rejected;
+    stats.queueDepth = source->count;
+    stats.framesPerSecond = seconds > 0 ? source->processed / seconds : 0;
+    stats.meanProcessingMs = source->processed > 0 ? source->processingMs / source->processed : 0;
+    return stats;
+}
+
+
+int TLDEngine::getStreamCount() {
+    unique_lock<mutex> guard(lock);
+    return (int)streams.size();
+}
+
+
+int TLDEngine::getThreadCount() {
+    return (int)workers.size();
+}
+
+
+TLDEngine::~TLDEngine() {
+    {
+        unique_lock<mutex> guard(lock);
+        stopping = true;
+    }
+    
+    wake.notify_all();
+    space.notify_all();
+    
+    for (int i = 0; i < (int)workers.size(); i++) {
+        workers[i].join();
+    }
+    
+    for (int i = 0; i < (int)streams.size(); i++) {
+        delete streams[i]->session;
+        delete [] streams[i]->frames;
+        delete streams[i];
+    }
+}
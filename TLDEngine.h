@@ -0,0 +1,208 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "TLDSession.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+/*  Receives the results of the frames processed by a TLDEngine. */
+class TLDResultListener {
+    // Public ================================================================
+    public:
+    /*  Called on an engine worker thread once a frame has been processed.
+        Results of each stream arrive in the order their frames were
+        submitted, one at a time; results of different streams may arrive
+        concurrently. MUST be implemented.
+        stream: stream the frame was submitted to
+        frameIndex: index of the frame among those submitted to the stream,
+            from 0
+        result: the result, only valid until this returns (see
+            TLDSession::process) */
+    virtual void onResult(int stream, unsigned long frameIndex, const TLDResult &result) = 0;
+    
+    /*  Destructor. */
+    virtual ~TLDResultListener() {}
+};
+
+
+/*  Counters describing a stream of a TLDEngine (see TLDEngine::getStats). */
+struct TLDStreamStats {
+    // Number of frames accepted, processed and rejected because the
+    // stream's queue was full
+    unsigned long submitted;
+    unsigned long processed;
+    unsigned long rejected;
+    
+    // Number of frames queued or being processed
+    int queueDepth;
+    
+    // Frames processed per second since the stream was added
+    double framesPerSecond;
+    
+    // Mean time to process a frame in milliseconds
+    double meanProcessingMs;
+};
+
+
+/*  Runs many TLD sessions, one per video stream, on one shared pool of
+    worker threads.
+    
+    Frames are submitted to a stream and copied into its queue, so the
+    caller's buffer can be reused straight away. Workers take streams with
+    queued frames in turn, round-robin, and process one frame of a stream at
+    a time, so each stream's frames are processed in order while different
+    streams are processed in parallel. A stream's session is only ever used
+    by one worker at a time, and runs on that worker alone: it scans
+    without a thread pool, and tracks, detects and learns in turn rather
+    than on threads of its own, whatever PIPELINED_DETECTION and
+    ASYNC_LEARNING are set to (see TLDSession::TLDSession). So the only
+    threads are the engine's workers, and the pool isn't oversubscribed.
+    
+    Each stream's queue has a fixed capacity. When it is full, a frame is
+    either rejected, so a live source keeps only frames that can be
+    processed, or the caller waits for room, for offline sources that must
+    not drop frames.
+    
+    All memory is allocated when a stream is added, so submitting and
+    processing frames doesn't allocate. */
+class TLDEngine {
+    // Private ===============================================================
+    private:
+    /*  The state of one stream. */
+    struct Stream {
+        // Session tracking the stream's object
+        TLDSession *session;
+        
+        // Size of each frame in pixels
+        int frameWidth;
+        int frameHeight;
+        
+        // Queued frames as a ring buffer of row-major frames
+        uint8_t *frames;
+        int head;
+        int count;
+        
+        // Set while a worker is processing the frame at the head
+        bool busy;
+        
+        // Counters (see TLDStreamStats) and the total processing time
+        unsigned long submitted;
+        unsigned long processed;
+        unsigned long rejected;
+        double processingMs;
+        
+        // When the stream was added
+        chrono::steady_clock::time_point added;
+    };
+    
+    // Worker threads
+    vector<thread> workers;
+    
+    // Streams in the order they were added; their indices are their ids
+    vector<Stream *> streams;
+    
+    // Maximum number of frames queued per stream
+    int capacity;
+    
+    // Receives results, or NULL
+    TLDResultListener *listener;
+    
+    // Index of the stream the next worker looks at first, so streams are
+    // served in turn
+    int cursor;
+    
+    // Guards the streams' queues and counters and is used with the
+    // condition variables
+    mutex lock;
+    
+    // Signalled when a frame is queued, a stream becomes free or the engine
+    // is being destroyed
+    condition_variable wake;
+    
+    // Signalled when a frame has been processed, making room in its queue
+    condition_variable space;
+    
+    // Signalled when every queued frame has been processed
+    condition_variable idle;
+    
+    // Set when the engine is being destroyed
+    bool stopping;
+    
+    /*  Main loop of each worker thread. */
+    void work(void);
+    
+    /*  Finds the next stream with a queued frame that no worker is
+        processing, starting from the cursor. MUST be called with the lock
+        held.
+        Returns the stream's index, or -1 if there is none. */
+    int nextReady(void);
+    
+    /*  Returns true if no stream has queued frames. MUST be called with the
+        lock held. */
+    bool isIdle(void);
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        threadNum: number of worker threads, or 0 to use one per hardware
+            thread
+        queueCapacity: maximum number of frames queued per stream */
+    TLDEngine(int threadNum, int queueCapacity);
+    
+    /*  Sets the listener that receives results. MUST be called before any
+        frame is submitted.
+        listener: the listener, or NULL to discard results */
+    void setListener(TLDResultListener *listener);
+    
+    /*  Adds a stream and initialises its session with the first frame, on
+        the calling thread. May be called while other streams are being
+        processed.
+        Returns the stream's id, or -1 with an error message if the session
+        couldn't be initialised.
+        frameWidth: width of the stream's frames
+        frameHeight: height of the stream's frames
+        pixels: pointer to the top-left pixel of the first frame
+        step: number of bytes between horizontally adjacent pixels
+        stride: number of bytes between vertically adjacent pixels
+        bb: bounding-box of the object [x, y, width, height] */
+    int addStream(int frameWidth, int frameHeight, const uint8_t *pixels, int step, int stride, const double *bb);
+    
+    /*  Queues the next frame of a stream for processing, copying it. Frames
+        of a stream MUST NOT be submitted from several threads at once.
+        Returns true if the frame was queued, false if the queue was full
+        and wait is false, or the stream doesn't exist.
+        stream: id of the stream (see addStream)
+        pixels: pointer to the top-left pixel of the frame
+        step: number of bytes between horizontally adjacent pixels
+        stride: number of bytes between vertically adjacent pixels
+        wait: true to wait for room if the queue is full, false to reject
+            the frame */
+    bool submit(int stream, const uint8_t *pixels, int step, int stride, bool wait);
+    
+    /*  Waits until every queued frame of every stream has been processed. */
+    void waitIdle(void);
+    
+    /*  Returns the counters of a stream, all 0 if it doesn't exist.
+        stream: id of the stream */
+    TLDStreamStats getStats(int stream);
+    
+    /*  Returns the number of streams added. */
+    int getStreamCount(void);
+    
+    /*  Returns the number of worker threads. */
+    int getThreadCount(void);
+    
+    /*  Destructor. Finishes the frames being processed, discards any queued
+        frames and joins the workers. */
+    ~TLDEngine(void);
+};
@@ -0,0 +1,465 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "TLDSession.h"
+#include <atomic>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+
+TLDSession::TLDSession(int frameWidth, int frameHeight, int detectorThreads, bool concurrent) {
+    this->frameWidth = frameWidth;
+    this->frameHeight = frameHeight;
+    this->detectorThreads = detectorThreads;
+    this->concurrent = concurrent;
+    frameSize = cvSize(frameWidth, frameHeight);
+    classifier = NULL;
+    tracker = NULL;
+    detector = NULL;
+    detections = NULL;
+    clusters = NULL;
+    learner = NULL;
+    pool = NULL;
+    pyramids = NULL;
+    threadPool = NULL;
+    scheduler = NULL;
+    pipeline = NULL;
+    initialised = false;
+    initBBWidth = 0;
+    initBBHeight = 0;
+    initVariance = 0;
+    confidence = 0;
+    
+    for (int i = 0; i < 5; i++) {
+        prevTbb[i] = 0;
+        tbb[i] = 0;
+    }
+}
+
+
+IplImage *TLDSession::acquireFrame(const uint8_t *pixels, int step, int stride) {
+    IplImage *image = pool->acquireImage();
+    
+    // The frame's pixels are about to change, and with them its pyramid
+    pyramids->invalidate(image);
+    
+    // Copy row-major frames a row at a time; otherwise loop through the
+    // frame column by column, which reads column-major frames in order
+    if (step == 1) {
+        for (int y = 0; y < frameHeight; y++) {
+            memcpy(image->imageData + y * image->widthStep, pixels + y * stride, frameWidth);
+        }
+    } else {
+        for (int x = 0; x < frameWidth; x++) {
+            for (int y = 0; y < frameHeight; y++) {
+                image->imageData[y * image->widthStep + x] = pixels[y * stride + x * step];
+            }
+        }
+    }
+    
+    return image;
+}
+
+
+void TLDSession::bbWarpPatch(IntegralImage *frame, double *bb) {
+    // Transformation matrix, and the warp, which is reused for every
+    // transformation
+    float m[4];
+    IntegralImage *warp = new IntegralImage();
+    
+    // Loop through various rotations and skews
+    for (float r = -0.1f; r < 0.1f; r += 0.005f) {
+        float sine = sin(r);
+        float cosine = cos(r);
+        
+        for (float sx = -0.1f; sx < 0.1f; sx += 0.05f) {
+            for (float sy = -0.1f; sy < 0.1f; sy += 0.05f) {
+                // Set transformation
+                /*  Rotation matrix * skew matrix =
+                    
+                    | cos r   sin r | * | 1   sx | = 
+                    | -sin r  cos r |   | sy   1 |
+                    
+                    | cos r + sy * sin r   sx * cos r + sin r |
+                    | sy * cos r - sin r   cos r - sx * sin r | */
+                m[0] = cosine + sy * sine;
+                m[1] = sx * cosine + sine;
+                m[2] = sy * cosine - sine;
+                m[3] = cosine - sx * sine;
+                
+                // Create warp and train classifier
+                warp->createWarp(frame, bb, m);
+                classifier->train(warp, 0, 0, (int)bb[2], (int)bb[3], 1);
+            }
+        }
+    }
+    
+    delete warp;
+}
+
+
+void TLDSession::trainNegative(IntegralImage *frame, double *tbb) {
+    // Minimum and maximum scales for the bounding-box, the number of scale
+    // iterations to make, and the amount to increment scale by each iteration
+    float minScale = 0.5f;
+    float maxScale = 1.5f;
+    int iterationsScale = 5;
+    float scaleInc = (maxScale - minScale) / (iterationsScale - 1);
+    
+    // Loop through a range of bounding-box scales
+    for (float scale = minScale; scale <= maxScale; scale += scaleInc) {
+        int minX = 0;
+        int currentWidth = (int)(scale * initBBWidth);
+        int maxX = frameWidth - currentWidth;
+        int iterationsX = 20;
+        int incX = (maxX - minX) / (iterationsX - 1);
+        
+        // If bounding-box width >= frame width, make only 1 iteration of the
+        // following for loop
+        if (incX <= 0) {
+            maxX = 0;
+            incX = 1;
+        }
+        
+        // Loop through all bounding-box top-left x-positions
+        for (int x = minX; x <= maxX; x += incX) {
+            // Same for y
+            int minY = 0;
+            int currentHeight = (int)(scale * initBBHeight);
+            int maxY = frameHeight - currentHeight;
+            int iterationsY = 20;
+            int incY = (maxY - minY) / (iterationsY - 1);
+            
+            // If bounding-box height >= frame height, make only 1 iteration
+            // of the following for loop
+            if (incY <= 0) {
+                maxY = 0;
+                incY = 1;
+            }
+            
+            // Loop through all bounding-box top-left x-positions
+            for (int y = minY; y <= maxY; y += incY) {
+                // Define the patch and test whether it's overlap with the
+                // first-frame patch is less than MIN_LEARNING_OVERLAP, if
+                // so, train as negative
+                double bb[4];
+                bb[0] = (double)x;
+                bb[1] = (double)y;
+                bb[2] = (double)currentWidth;
+                bb[3] = (double)currentHeight;
+                
+                if (Detector::bbOverlap(tbb, bb) < MIN_LEARNING_OVERLAP) {
+                    classifier->train(frame, x, y, currentWidth, currentHeight, 0);
+                } else {
+                    //classifier->train(frame, x, y, currentWidth, currentHeight, 1);
+                }
+            }
+        }
+    }
+}
+
+
+void TLDSession::learnFromCodes(const int *codes, int patchClass) {
+    if (learner != NULL) {
+        learner->enqueue(codes, patchClass);
+    } else {
+        classifier->trainFromCodes(codes, patchClass);
+    }
+}
+
+
+void TLDSession::release() {
+    // The learner trains the classifier, and the pipeline uses the tracker
+    // and detector, so they go first
+    delete learner;
+    delete pipeline;
+    delete classifier;
+    delete tracker;
+    delete detector;
+    delete detections;
+    delete clusters;
+    delete pool;
+    delete pyramids;
+    delete threadPool;
+    delete scheduler;
+    learner = NULL;
+    pipeline = NULL;
+    classifier = NULL;
+    tracker = NULL;
+    detector = NULL;
+    detections = NULL;
+    clusters = NULL;
+    pool = NULL;
+    pyramids = NULL;
+    threadPool = NULL;
+    scheduler = NULL;
+    initialised = false;
+}
+
+
+bool TLDSession::init(const uint8_t *pixels, int step, int stride, const double *bb) {
+    // Free any previous state
+    release();
+    
+    // Create the classifier first, so unsupported parameters leave us
+    // uninitialised
+    // Seed from the time and the number of sessions initialised so far, so
+    // sessions initialised in the same second still differ
+    static std::atomic<unsigned int> inits(0);
+    random.seed((unsigned int)time(0) + inits++);
+    classifier = Classifier::create(TOTAL_FERNS, TOTAL_NODES, FEATURE_TYPE, MIN_FEATURE_SCALE, MAX_FEATURE_SCALE, random);
+    
+    if (classifier == NULL) {
+        printf("ERROR: TLD NOT INITIALISED!\n");
+        return false;
+    }
+    
+    // Allocate every frame buffer the session needs up front
+    pool = new FramePool(frameWidth, frameHeight, POOLED_FRAMES, POOLED_INTEGRAL_IMAGES, MIN_VARIANCE_FRACTION > 0);
+    pyramids = new PyramidCache(POOLED_FRAMES, cv::Size(2 * MAX_WINDOW_SIZE + 1, 2 * MAX_WINDOW_SIZE + 1), MAX_LEVEL);
+    threadPool = new ThreadPool(detectorThreads);
+    IplImage *firstFrameIplImage = acquireFrame(pixels, step, stride);
+    IntegralImage *firstFrame = pool->acquireIntegralImage();
+    firstFrame->createFromBuffer((uint8_t *)firstFrameIplImage->imageData, frameWidth, frameHeight, firstFrameIplImage->widthStep);
+    double firstBB[4] = {bb[0], bb[1], bb[2], bb[3]};
+    initBBWidth = (float)bb[2];
+    initBBHeight = (float)bb[3];
+    confidence = 1.0f;
+    
+    // The first frame is tracked from the selected bounding-box
+    for (int i = 0; i < 4; i++) {
+        tbb[i] = bb[i];
+    }
+    
+    tbb[4] = confidence;
+    
+    // Record the variance of the bounding-box patch, limited to the frame
+    initVariance = 0;
+    
+    if (firstFrame->hasSquares()) {
+        int x = std::max(std::min((int)bb[0], frameWidth - 1), 0);
+        int y = std::max(std::min((int)bb[1], frameHeight - 1), 0);
+        int w = std::max(std::min((int)initBBWidth, frameWidth - x), 1);
+        int h = std::max(std::min((int)initBBHeight, frameHeight - y), 1);
+        initVariance = firstFrame->varianceUnchecked(x, y, w, h);
+    }
+    
+    // Initialise tracker and detector
+    tracker = new Tracker(frameWidth, frameHeight, &frameSize, firstFrameIplImage, classifier, pool, pyramids);
+    detector = new Detector(frameWidth, frameHeight, firstBB, classifier, threadPool, initVariance * MIN_VARIANCE_FRACTION);
+    detections = new DetectionSet(MAX_WINDOWS, classifier->getFernCount());
+    clusters = new DetectionClusters(frameWidth, frameHeight, MAX_WINDOWS);
+    scheduler = new FrameScheduler(FRAME_BUDGET_MS, concurrent && PIPELINED_DETECTION);
+    pipeline = concurrent && PIPELINED_DETECTION ? new FramePipeline(tracker, detector, scheduler) : NULL;
+    
+    // Train the classifier on the bounding-box patch and warps of it
+    classifier->train(firstFrame, (int)bb[0], (int)bb[1], (int)initBBWidth, (int)initBBHeight, 1);
+    bbWarpPatch(firstFrame, firstBB);
+    trainNegative(firstFrame, firstBB);
+    classifier->publish();
+    learner = concurrent && ASYNC_LEARNING ? new BackgroundLearner(classifier, LEARNING_QUEUE_SIZE) : NULL;
+    
+    // Free memory and set initialised
+    pool->releaseIntegralImage(firstFrame);
+    initialised = true;
+    
+    return true;
+}
+
+
+TLDResult TLDSession::process(const uint8_t *pixels, int step, int stride) {
+    // Choose the quality to process this frame at
+    int level = scheduler->beginFrame();
+    detector->setScanPositions(scheduler->getScanPositions());
+    
+    
+    // Get Input -------------------------------------------------------------
+    // Current frame. The integral image is built from the IplImage as its
+    // rows are contiguous, unlike those of a column-major frame
+    IplImage *nextFrame = acquireFrame(pixels, step, stride);
+    IntegralImage *nextFrameIntImg = pool->acquireIntegralImage();
+    nextFrameIntImg->createFromBuffer((uint8_t *)nextFrame->imageData, frameWidth, frameHeight, nextFrame->widthStep);
+    
+    // Previous frame's trajectory bounding-box [x, y, width, height], which
+    // is tracked from
+    double *bb = prevTbb;
+    
+    for (int i = 0; i < 5; i++) {
+        prevTbb[i] = tbb[i];
+    }
+    
+    
+    // Track and Detect ------------------------------------------------------
+    // Only track if we were confident enough in the previous iteration
+    // The tracker handles the releasing of nextFrame from here on
+    bool detected = true;
+    bool tracked = confidence > MIN_TRACKING_CONF;
+    
+    if (tracked) {
+        // The scheduler may skip detection, leaving the tracker to follow
+        // the object on its own this frame
+        detected = scheduler->shouldDetect();
+        
+        if (pipeline != NULL) {
+            // Detect around where the tracker predicts the bounding-box
+            // moves to while tracking
+            double predictedBB[4];
+            tracker->predict(bb, predictedBB);
+            pipeline->process(nextFrame, nextFrameIntImg, bb, predictedBB, tbb, detected ? detections : NULL, ROI_SCANNING && confidence > MIN_ROI_CONF);
+        } else {
+            scheduler->beginStage(STAGE_TRACK);
+            tracker->track(nextFrame, nextFrameIntImg, bb, tbb);
+            scheduler->endStage(STAGE_TRACK);
+            
+            if (detected) {
+                scheduler->beginStage(STAGE_DETECT);
+                detector->detect(nextFrameIntImg, tbb, detections, ROI_SCANNING && tbb[4] > MIN_ROI_CONF, false);
+                scheduler->endStage(STAGE_DETECT);
+            }
+        }
+        
+        if (!detected) {
+            detections->clear();
+        }
+    } else {
+        // Without the tracker, only the detector can find the object again,
+        // so it always runs
+        scheduler->beginStage(STAGE_DETECT);
+        detector->detect(nextFrameIntImg, NULL, detections, false, false);
+        scheduler->endStage(STAGE_DETECT);
+        tracker->setPrevFrame(nextFrame);
+        tbb[0] = 0;
+        tbb[1] = 0;
+        tbb[2] = 0;
+        tbb[3] = 0;
+        tbb[4] = MIN_TRACKING_CONF;
+    }
+    
+    
+    // Cluster ---------------------------------------------------------------
+    // Group overlapping detections so each group is only fused, learnt from
+    // and output once, through its most confident detection
+    int dbbCount = detections->size();
+    
+    if (CLUSTER_DETECTIONS) {
+        clusters->cluster(detections, MIN_CLUSTER_OVERLAP);
+        dbbCount = clusters->size();
+    }
+    
+    
+    // Learn -----------------------------------------------------------------
+    // Get greatest detected patch confidence
+    double dbbMaxConf = 0.0f;
+    int dbbMaxConfIndex = -1;
+    
+    double *dbbConfs = detections->getConfidences();
+    
+    for (int i = 0; i < dbbCount; i++) {
+        int dbbIndex = CLUSTER_DETECTIONS ? clusters->getRepresentative(i) : i;
+        double dbbConf = dbbConfs[dbbIndex];
+        
+        if (dbbConf > dbbMaxConf) {
+            dbbMaxConf = dbbConf;
+            dbbMaxConfIndex = dbbIndex;
+        }
+    }
+    
+    // Reset the tracker bounding-box if a detected patch had highest
+    // confidence and is more confident than MIN_REINIT_CONF. The motion
+    // tracked so far led elsewhere, so the tracker starts afresh
+    if (dbbMaxConf > tbb[4] && dbbMaxConf > MIN_REINIT_CONF) {
+        tracker->resetMotion();
+        tbb[0] = detections->getXs()[dbbMaxConfIndex];
+        tbb[1] = detections->getYs()[dbbMaxConfIndex];
+        tbb[2] = detections->getWidths()[dbbMaxConfIndex];
+        tbb[3] = detections->getHeights()[dbbMaxConfIndex];
+        tbb[4] = dbbConfs[dbbMaxConfIndex];
+    }
+    
+    // Apply constraints if the tracked patch had the greatest confidence and
+    // we were confident enough last frame, unless the scheduler is skipping
+    // learning to save time
+    else if (tbb[4] > dbbMaxConf && confidence > MIN_LEARNING_CONF && scheduler->shouldLearn()) {
+        double *dbbOverlaps = detections->getOverlaps();
+        scheduler->beginStage(STAGE_LEARN);
+        
+        for (int i = 0; i < dbbCount; i++) {
+            // Train the classifier on positive (overlapping with tracked
+            // patch) and negative (classed as positive but non-overlapping)
+            // patches. The detector kept the leaf node indices it found for
+            // each patch, so no features need evaluating
+            int dbbIndex = CLUSTER_DETECTIONS ? clusters->getRepresentative(i) : i;
+            
+            if (dbbOverlaps[dbbIndex] == 1) {
+                learnFromCodes(detections->getCodes(dbbIndex), 1);
+            }
+            else if (dbbOverlaps[dbbIndex] == 0) {
+                learnFromCodes(detections->getCodes(dbbIndex), 0);
+            }
+        }
+        
+        // Without the background learner, classify with the new training
+        // from the next frame on
+        if (learner == NULL) {
+            classifier->publish();
+        }
+        
+        scheduler->endStage(STAGE_LEARN);
+    }
+    
+    // Set confidence for next iteration
+    confidence = tbb[4];
+    
+    
+    // Set output ------------------------------------------------------------
+    // The result holds the tracked bounding-box and the detected ones, or
+    // the most confident of each cluster of them if CLUSTER_DETECTIONS
+    TLDResult result;
+    
+    for (int i = 0; i < 5; i++) {
+        result.tbb[i] = tbb[i];
+    }
+    
+    result.detections = detections;
+    result.detectionIndices = CLUSTER_DETECTIONS ? clusters->getRepresentatives() : NULL;
+    result.detectionCount = dbbCount;
+    result.stats = detected ? detector->getStats() : DetectorStats();
+    result.trackerStats = tracked ? tracker->getStats() : TrackerStats();
+    result.level = level;
+    
+    // Return the integral image to the pool
+    pool->releaseIntegralImage(nextFrameIntImg);
+    scheduler->endFrame();
+    
+    return result;
+}
+
+
+void TLDSession::flushLearning() {
+    if (learner != NULL) {
+        learner->flush();
+    }
+}
+
+
+bool TLDSession::isInitialised() {
+    return initialised;
+}
+
+
+int TLDSession::getFrameWidth() {
+    return frameWidth;
+}
+
+
+int TLDSession::getFrameHeight() {
+    return frameHeight;
+}
+
+
+TLDSession::~TLDSession() {
+    release();
+}
@@ -0,0 +1,291 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include "opencv2/core/core_c.h"
+#include "BackgroundLearner.h"
+#include "Classifier.h"
+#include "DetectionClusters.h"
+#include "DetectionSet.h"
+#include "Detector.h"
+#include "FramePipeline.h"
+#include "FramePool.h"
+#include "FrameScheduler.h"
+#include "PyramidCache.h"
+#include "ThreadPool.h"
+#include "Tracker.h"
+#include <stdint.h>
+
+
+// Constants -----------------------------------------------------------------
+// Number of ferns in the classifier
+#define TOTAL_FERNS 10
+
+// Number of nodes per fern
+#define TOTAL_NODES 5
+
+// Type of feature used by the fern nodes, FEATURE_TWO_BIT_BP or FEATURE_HAAR
+// Note: Classifier::create only supports some combinations of these three
+#define FEATURE_TYPE FEATURE_TWO_BIT_BP
+
+// Minimum percentage of patch width and height a feature can take
+#define MIN_FEATURE_SCALE 0.1f
+
+// Maximum percentage of patch width and height a feature can take
+#define MAX_FEATURE_SCALE 0.5f
+
+// Minimum confidence of the previous frame trajectory patch for us to learn
+// this frame
+#define MIN_LEARNING_CONF 0.8
+
+// When a detected patch has higher confidence than the tracked patch, it must
+// still have higher confidence than this for us to reinitialise
+// Note: Should be <= MIN_LEARNING_CONF
+#define MIN_REINIT_CONF 0.8
+
+// Minimum confidence of the tracked patch in the previous frame for us to
+// track in the next frame
+#define MIN_TRACKING_CONF 0.1
+
+// 1 to let the detector focus on the tracked patch when it is confident
+// enough (see Detector::detect), 0 to always scan the whole frame
+#define ROI_SCANNING 1
+
+// Minimum confidence of the tracked patch this frame for the detector to
+// focus on it
+// Note: Should be >= MIN_TRACKING_CONF
+#define MIN_ROI_CONF 0.5
+
+// Number of frames held in the frame pool: the tracker's previous frame and
+// the frame being processed
+#define POOLED_FRAMES 2
+
+// Number of integral images held in the frame pool: the frame being
+// processed
+#define POOLED_INTEGRAL_IMAGES 1
+
+// Number of threads the detector of a session driven from Matlab scans
+// with, or 0 for one per hardware thread (see TLDSession::TLDSession)
+#define DETECTOR_THREADS 0
+
+// Windows with a pixel variance below this fraction of the first-frame
+// bounding-box patch's variance are rejected by the detector without being
+// classified. 0 disables the variance filter
+#define MIN_VARIANCE_FRACTION 0.5
+
+// 1 to group overlapping detections into clusters and fuse, learn from and
+// output only the most confident detection of each (see DetectionClusters),
+// 0 to use every detection
+#define CLUSTER_DETECTIONS 1
+
+// Minimum overlap between a detection and a cluster's most confident
+// detection for the detection to join the cluster
+#define MIN_CLUSTER_OVERLAP 0.5
+
+// 1 to detect concurrently with tracking, around the bounding-box the
+// tracker predicts (see FramePipeline), 0 to detect after tracking, around
+// the tracked bounding-box. Sessions that may not start threads of their
+// own detect after tracking regardless (see TLDSession::TLDSession)
+#define PIPELINED_DETECTION 1
+
+// 1 to train the classifier on a background thread (see
+// BackgroundLearner), 0 to train it before returning each frame's result.
+// Sessions that may not start threads of their own train before returning
+// regardless
+#define ASYNC_LEARNING 1
+
+// Maximum number of training patches queued for the background thread; the
+// oldest are dropped beyond this
+#define LEARNING_QUEUE_SIZE 1024
+
+// Latency budget of each frame in milliseconds. Frames predicted to overrun
+// it are processed at lower quality (see FrameScheduler). 0 processes every
+// frame at full quality
+#define FRAME_BUDGET_MS 33
+
+
+/*  The result of processing a frame (see TLDSession::process). */
+struct TLDResult {
+    // Trajectory bounding-box [x, y, width, height, confidence]. All but the
+    // confidence are 0 if the object is lost
+    double tbb[5];
+    
+    // Bounding-boxes found by the detector: the positive detections, or the
+    // most confident detection of each cluster of them if
+    // CLUSTER_DETECTIONS, along with the negative detections overlapping the
+    // trajectory bounding-box. The set belongs to the session and is only
+    // valid until the next call to process
+    DetectionSet *detections;
+    
+    // Positions in detections of the bounding-boxes found, or NULL if they
+    // are all of detections, and their number
+    const int *detectionIndices;
+    int detectionCount;
+    
+    // Number of windows handled by each detector stage, all 0 if the
+    // detector didn't run
+    DetectorStats stats;
+    
+    // Parameters and work of the tracker, all 0 if the tracker didn't run
+    TrackerStats trackerStats;
+    
+    // Level of quality the frame was processed at (see FrameScheduler)
+    int level;
+};
+
+
+/*  A TLD session: tracks one object through one video stream.
+    
+    All of the state of the tracker, detector and classifier is held by the
+    session, so any number of sessions can run in one process, each on its
+    own thread. Frames are raw 8-bit greyscale buffers held by the caller;
+    pixel (x, y) of a frame is at pixels[y * stride + x * step], so both
+    row-major buffers (step 1) and column-major ones such as Matlab's
+    (stride 1) can be passed without conversion.
+    
+    Everything a session needs is allocated by init, so processing frames
+    doesn't allocate (see AllocationCounter.h). */
+class TLDSession {
+    // Private ===============================================================
+    private:
+    // Size of each frame
+    int frameWidth;
+    int frameHeight;
+    CvSize frameSize;
+    
+    // Number of threads the detector scans with, and whether the session
+    // may start threads of its own for PIPELINED_DETECTION and
+    // ASYNC_LEARNING
+    int detectorThreads;
+    bool concurrent;
+    
+    // Random number generator of this session, seeded on init, so sessions
+    // don't share the random state of rand
+    std::mt19937 random;
+    
+    // Our classifier, tracker and detector
+    Classifier *classifier;
+    Tracker *tracker;
+    Detector *detector;
+    
+    // Bounding-boxes found by the detector in the current frame, and their
+    // clusters
+    DetectionSet *detections;
+    DetectionClusters *clusters;
+    
+    // Trains the classifier in the background if ASYNC_LEARNING and
+    // concurrent, otherwise NULL
+    BackgroundLearner *learner;
+    
+    // Pool of frame buffers reused from frame to frame, and the optical flow
+    // pyramids of its frames
+    FramePool *pool;
+    PyramidCache *pyramids;
+    
+    // Threads the detector scans with
+    ThreadPool *threadPool;
+    
+    // Chooses the quality each frame is processed at to meet FRAME_BUDGET_MS
+    FrameScheduler *scheduler;
+    
+    // Tracks and detects concurrently if PIPELINED_DETECTION and
+    // concurrent, otherwise NULL
+    FramePipeline *pipeline;
+    
+    // Whether the session has been initialised
+    bool initialised;
+    
+    // Initial size of the bounding-box
+    float initBBWidth;
+    float initBBHeight;
+    
+    // Pixel variance of the first-frame bounding-box patch
+    double initVariance;
+    
+    // Confidence of the previous frame's trajectory patch
+    double confidence;
+    
+    // Trajectory bounding-box of the previous and current frames
+    // [x, y, width, height, confidence]
+    double prevTbb[5];
+    double tbb[5];
+    
+    /*  Copies a frame held by the caller into an image from the pool.
+        Returns the image.
+        pixels: pointer to the top-left pixel
+        step: number of bytes between horizontally adjacent pixels
+        stride: number of bytes between vertically adjacent pixels */
+    IplImage *acquireFrame(const uint8_t *pixels, int step, int stride);
+    
+    /*  Trains the classifier on warps of a bounding-box patch.
+        frame: frame to take warps from
+        bb: first-frame bounding-box [x, y, width, height] */
+    void bbWarpPatch(IntegralImage *frame, double *bb);
+    
+    /*  Trains the classifier on negative training patches, i.e. patches from
+        the first frame that don't overlap the bounding-box patch.
+        frame: frame to take warps from
+        tbb: first-frame bounding-box [x, y, width, height] */
+    void trainNegative(IntegralImage *frame, double *tbb);
+    
+    /*  Trains the classifier on a patch given its leaf node indices, on the
+        background thread if there is one (see learner).
+        codes: leaf node index of the patch in each fern
+        patchClass: 0 if the patch is negative, 1 if the patch is positive */
+    void learnFromCodes(const int *codes, int patchClass);
+    
+    /*  Frees everything allocated by init. */
+    void release(void);
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor. Creates an uninitialised session; call init before
+        processing frames.
+        frameWidth: width of the video stream frames
+        frameHeight: height of the video stream frames
+        detectorThreads: number of threads the detector scans with,
+            including the calling thread, or 0 for one per hardware thread.
+            Use 1 when running many sessions at once (see TLDEngine)
+        concurrent: true to track and detect concurrently and learn in the
+            background as PIPELINED_DETECTION and ASYNC_LEARNING set, each
+            on a thread of the session's own; false to do everything on the
+            calling thread, e.g. when running many sessions on a shared pool
+            of threads (see TLDEngine) */
+    TLDSession(int frameWidth, int frameHeight, int detectorThreads, bool concurrent);
+    
+    /*  (Re)initialises the session with the first frame and the bounding-box
+        of the object to track in it, discarding any previous state.
+        Returns true on success, false with an error message otherwise.
+        pixels: pointer to the top-left pixel of the first frame
+        step: number of bytes between horizontally adjacent pixels
+        stride: number of bytes between vertically adjacent pixels
+        bb: bounding-box of the object [x, y, width, height] */
+    bool init(const uint8_t *pixels, int step, int stride, const double *bb);
+    
+    /*  Tracks and detects the object in the next frame of the stream, and
+        learns from the result. MUST only be called once initialised.
+        Returns the result for the frame.
+        pixels: pointer to the top-left pixel of the frame
+        step: number of bytes between horizontally adjacent pixels
+        stride: number of bytes between vertically adjacent pixels */
+    TLDResult process(const uint8_t *pixels, int step, int stride);
+    
+    /*  Waits until the classifier has been trained on, and publishes, every
+        patch learnt from so far (see BackgroundLearner::flush). Returns at
+        once without a background learner, as learning is then done by the
+        time process returns. */
+    void flushLearning(void);
+    
+    /*  Returns true if the session has been initialised. */
+    bool isInitialised(void);
+    
+    /*  Getters for the frame size. */
+    int getFrameWidth(void);
+    int getFrameHeight(void);
+    
+    /*  Destructor. */
+    ~TLDSession(void);
+};
@@ -0,0 +1,116 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "ThreadPool.h"
+
+
+ThreadPool::ThreadPool(int threadNum) {
+    task = NULL;
+    taskCount = 0;
+    nextIndex = 0;
+    busyWorkers = 0;
+    generation = 0;
+    stopping = false;
+    
+    if (threadNum <= 0) {
+        threadNum = (int)thread::hardware_concurrency();
+    }
+    
+    // The calling thread is one of the threads
+    for (int i = 1; i < threadNum; i++) {
+        workers.push_back(thread(&ThreadPool::work, this));
+    }
+}
+
+
+void ThreadPool::work() {
+    unsigned long seenGeneration = 0;
+    
+    while (true) {
+        // Wait for a new job
+        {
+            unique_lock<mutex> guard(lock);
+            
+            while (!stopping && generation == seenGeneration) {
+                wake.wait(guard);
+            }
+            
+            if (stopping) {
+                return;
+            }
+            
+            seenGeneration = generation;
+        }
+        
+        runTasks();
+        
+        // Let run know once every worker has finished
+        {
+            unique_lock<mutex> guard(lock);
+            
+            if (--busyWorkers == 0) {
+                done.notify_one();
+            }
+        }
+    }
+}
+
+
+void ThreadPool::runTasks() {
+    for (int i = nextIndex++; i < taskCount; i = nextIndex++) {
+        task->run(i);
+    }
+}
+
+
+void ThreadPool::run(ParallelTask *task, int count) {
+    // Run small jobs, or all jobs if we have no workers, on this thread
+    if (workers.empty() || count <= 1) {
+        for (int i = 0; i < count; i++) {
+            task->run(i);
+        }
+        
+        return;
+    }
+    
+    // Publish the job and wake the workers
+    {
+        unique_lock<mutex> guard(lock);
+        this->task = task;
+        taskCount = count;
+        nextIndex = 0;
+        busyWorkers = (int)workers.size();
+        generation++;
+    }
+    
+    wake.notify_all();
+    
+    // Help out, then wait for the workers to finish
+    runTasks();
+    unique_lock<mutex> guard(lock);
+    
+    while (busyWorkers > 0) {
+        done.wait(guard);
+    }
+}
+
+
+int ThreadPool::getThreadCount() {
+    return (int)workers.size() + 1;
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        unique_lock<mutex> guard(lock);
+        stopping = true;
+    }
+    
+    wake.notify_all();
+    
+    for (int i = 0; i < (int)workers.size(); i++) {
+        workers[i].join();
+    }
+}
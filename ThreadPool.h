@@ -0,0 +1,99 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+/*  A unit of parallel work made up of independent, indexed tasks. Subclasses
+    implement run, which may be called concurrently from several threads for
+    different indices. */
+class ParallelTask {
+    // Public ================================================================
+    public:
+    /*  Performs one task. MUST be implemented.
+        index: index of the task to perform */
+    virtual void run(int index) = 0;
+    
+    /*  Destructor. */
+    virtual ~ParallelTask() {}
+};
+
+
+/*  A fixed-size pool of worker threads that performs the tasks of a
+    ParallelTask in parallel.
+    
+    Tasks are claimed dynamically: each thread repeatedly takes the next
+    unclaimed task index from a shared atomic counter, so threads that finish
+    early take over work that would otherwise wait behind slower tasks. The
+    calling thread takes part too, so a pool of n threads creates n - 1
+    workers.
+    
+    Starting a job does not allocate, so a pool can be used in the
+    steady-state frame loop. */
+class ThreadPool {
+    // Private ===============================================================
+    private:
+    // Worker threads
+    vector<thread> workers;
+    
+    // Guards the job state below and is used with the condition variables
+    mutex lock;
+    
+    // Signalled when a new job starts or the pool is being destroyed
+    condition_variable wake;
+    
+    // Signalled when the last worker finishes the current job
+    condition_variable done;
+    
+    // Current job and its number of tasks
+    ParallelTask *task;
+    int taskCount;
+    
+    // Index of the next unclaimed task of the current job
+    atomic<int> nextIndex;
+    
+    // Number of workers yet to finish the current job
+    int busyWorkers;
+    
+    // Incremented for every job, so workers can tell a new job has started
+    unsigned long generation;
+    
+    // Set when the pool is being destroyed
+    bool stopping;
+    
+    /*  Main loop of each worker thread. */
+    void work(void);
+    
+    /*  Claims and runs tasks of the current job until none remain. */
+    void runTasks(void);
+    
+    
+    // Public ================================================================
+    public:
+    /*  Constructor.
+        threadNum: total number of threads to use, including the calling
+            thread, or 0 to use one per hardware thread */
+    ThreadPool(int threadNum);
+    
+    /*  Runs tasks 0 to count - 1 of the given task across the pool and
+        returns once all have completed. Must not be called concurrently
+        from several threads.
+        task: task to run
+        count: number of tasks */
+    void run(ParallelTask *task, int count);
+    
+    /*  Returns the total number of threads used, including the caller. */
+    int getThreadCount(void);
+    
+    /*  Destructor. Stops and joins the workers. */
+    ~ThreadPool(void);
+};
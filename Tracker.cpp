@@ -6,180 +6,316 @@
 #include "Tracker.h"
 
 
-Tracker::Tracker(int frameWidth, int frameHeight, CvSize *frameSize, IplImage *firstFrame, Classifier *classifier) {
+Tracker::Tracker(int frameWidth, int frameHeight, CvSize *frameSize, IplImage *firstFrame, Classifier *classifier, FramePool *pool, PyramidCache *pyramids) {
     width = frameWidth;
     height = frameHeight;
     prevFrame = firstFrame;
+#ifdef TLD_LEGACY_TRACKER
     prevPyramid = cvCreateImage(*frameSize, IPL_DEPTH_8U, 1);
     nextPyramid = cvCreateImage(*frameSize, IPL_DEPTH_8U, 1);
-    prevPoints = (CvPoint2D32f *)cvAlloc(TOTAL_POINTS * sizeof(CvPoint2D32f));
-    nextPoints = (CvPoint2D32f *)cvAlloc(TOTAL_POINTS * sizeof(CvPoint2D32f));
-    //predPoints = (CvPoint2D32f *)cvAlloc(TOTAL_POINTS * sizeof(CvPoint2D32f));
-    windowSize = (CvSize *)malloc(sizeof(CvSize));
-    *windowSize = cvSize(WINDOW_SIZE, WINDOW_SIZE);
-    status = (char *)cvAlloc(TOTAL_POINTS);
-    //predStatus = (char *)cvAlloc(TOTAL_POINTS);
-    termCriteria = (TermCriteria *)malloc(sizeof(TermCriteria));
-    *termCriteria = TermCriteria(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 20, 0.03);
+    prevPyramidReady = false;
+    prevPyramidLevel = 0;
+    (void)pyramids;
+#else
+    // Pyramids come from the cache, so the frame size isn't needed
+    (void)frameSize;
+    this->pyramids = pyramids;
+#endif
+    prevPoints.resize(TOTAL_POINTS);
+    nextPoints.resize(TOTAL_POINTS);
+    predPoints.resize(TOTAL_POINTS);
+    level = MAX_LEVEL;
+    windowSize = MIN_WINDOW_SIZE;
+    resetMotion();
+    stats = TrackerStats();
+    status.resize(TOTAL_POINTS);
+    predStatus.resize(TOTAL_POINTS);
+    termCriteria = TermCriteria(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 20, 0.03);
     this->classifier = classifier;
+    this->pool = pool;
+    flow = new MedianFlow(TOTAL_POINTS, PAIR_SAMPLES);
+    errors = (float *)malloc(TOTAL_POINTS * sizeof(float));
+    sortedErrors = (float *)malloc(TOTAL_POINTS * sizeof(float));
 }
 
 
-float Tracker::median(float *A, int length) {
-    int index = (int)(length / 2);
-    std::sort(A, A + length);
+void Tracker::chooseParameters(double bbWidth, double bbHeight) {
+    level = MAX_LEVEL;
+    windowSize = MIN_WINDOW_SIZE;
     
-    if (length % 2 == 0) {
-        return (A[index] + A[index + 1]) / 2;
+    if (!ADAPTIVE_TRACKING) {
+        return;
     }
-    else {
-        return A[index];
+    
+    // Use a window about as wide as the spacing of the points
+    double side = std::min(bbWidth, bbHeight);
+    windowSize = std::max(std::min((int)(side / (DIM_POINTS + 1)), MAX_WINDOW_SIZE), MIN_WINDOW_SIZE);
+    
+    // Find the deepest level at which the bounding-box is still big enough
+    int deepest = MIN_LEVEL;
+    
+    while (deepest < MAX_LEVEL && side / (2 << deepest) >= MIN_LEVEL_BB_SIZE) {
+        deepest++;
+    }
+    
+    // Without recent motion to go by, go as deep as possible
+    if (!motionKnown) {
+        level = deepest;
+        return;
+    }
+    
+    // Each level follows displacements of up to about the window size at
+    // its scale, so levels 0 to l follow up to windowSize * (2^(l+1) - 1).
+    // Use the shallowest level that follows the expected displacement, and
+    // widen the window if even the deepest level doesn't
+    double reach = MOTION_MARGIN * motion;
+    level = MIN_LEVEL;
+    
+    while (level < deepest && windowSize * ((2 << level) - 1) < reach) {
+        level++;
+    }
+    
+    while (windowSize < MAX_WINDOW_SIZE && windowSize * ((2 << level) - 1) < reach) {
+        windowSize++;
+    }
+}
+
+
+bool Tracker::predict(const double *bb, double *predicted) {
+    bool known = MOTION_PREDICTION && motionKnown;
+    double dx = known ? velocityX : 0;
+    double dy = known ? velocityY : 0;
+    double scale = known ? scaleChange : 1;
+    
+    // The bounding-box scales about its centre
+    predicted[0] = bb[0] + dx - 0.5 * bb[2] * (scale - 1);
+    predicted[1] = bb[1] + dy - 0.5 * bb[3] * (scale - 1);
+    predicted[2] = bb[2] * scale;
+    predicted[3] = bb[3] * scale;
+    
+    return known;
+}
+
+
+void Tracker::filterPoints(IplImage *nextFrame) {
+    // Track the points back to the previous frame, starting from where they
+    // started. Both pyramids were built by forward tracking
+    for (int i = 0; i < TOTAL_POINTS; i++) {
+        predPoints[i] = prevPoints[i];
+    }
+    
+#ifdef TLD_LEGACY_TRACKER
+    cvCalcOpticalFlowPyrLK(nextFrame, prevFrame, nextPyramid, prevPyramid, (CvPoint2D32f *)&nextPoints[0], (CvPoint2D32f *)&predPoints[0], TOTAL_POINTS, cvSize(windowSize, windowSize), level, (char *)&predStatus[0], 0, termCriteria, CV_LKFLOW_INITIAL_GUESSES | CV_LKFLOW_PYR_A_READY | CV_LKFLOW_PYR_B_READY);
+#else
+    calcOpticalFlowPyrLK(pyramids->get(nextFrame, level), pyramids->get(prevFrame, level), nextPoints, predPoints, predStatus, noArray(), Size(2 * windowSize + 1, 2 * windowSize + 1), level, termCriteria, OPTFLOW_USE_INITIAL_FLOW);
+#endif
+    
+    stats.solves += TOTAL_POINTS * (level + 1);
+    
+    // Measure the forward-backward error of each point tracked both ways
+    int tracked = 0;
+    
+    for (int i = 0; i < TOTAL_POINTS; i++) {
+        if (status[i] == 1 && predStatus[i] == 1) {
+            float dx = predPoints[i].x - prevPoints[i].x;
+            float dy = predPoints[i].y - prevPoints[i].y;
+            errors[i] = sqrt(dx * dx + dy * dy);
+            sortedErrors[tracked++] = errors[i];
+        } else {
+            status[i] = 0;
+        }
+    }
+    
+    if (tracked == 0) {
+        stats.reliablePoints = 0;
+        return;
+    }
+    
+    // Keep the points with at most the median error
+    float maxError = MedianFlow::median(sortedErrors, tracked);
+    
+    for (int i = 0; i < TOTAL_POINTS; i++) {
+        if (status[i] == 1 && errors[i] > maxError) {
+            status[i] = 0;
+            tracked--;
+        }
     }
+    
+    stats.reliablePoints = tracked;
 }
 
 
-double *Tracker::track(IplImage *nextFrame, IntegralImage *nextFrameIntImg, double *bb) {
+void Tracker::track(IplImage *nextFrame, IntegralImage *nextFrameIntImg, double *bb, double *bbNew) {
     // Perform Lucas-Kanade Tracking -----------------------------------------
-    // Distribute points to track uniformly over the bounding-box
+    // Distribute points to track uniformly over the bounding-box, and
+    // search for each from the same position in the predicted bounding-box
     double bbWidth = bb[2];
     double bbHeight = bb[3];
     double stepX = bbWidth / (DIM_POINTS + 1);
     double stepY = bbHeight / (DIM_POINTS + 1);
+    double predicted[4];
+    bool isPredicted = predict(bb, predicted);
+    double predictedStepX = predicted[2] / (DIM_POINTS + 1);
+    double predictedStepY = predicted[3] / (DIM_POINTS + 1);
     int i, x, y;
     
     for (i = 0, x = 1; x <= DIM_POINTS; x++) {
         for (y = 1; y <= DIM_POINTS; y++, i++) {
             prevPoints[i].x = (float)(bb[0] + x * stepX);
             prevPoints[i].y = (float)(bb[1] + y * stepY);
-            nextPoints[i].x = prevPoints[i].x;
-            nextPoints[i].y = prevPoints[i].y;
+            nextPoints[i].x = (float)(predicted[0] + x * predictedStepX);
+            nextPoints[i].y = (float)(predicted[1] + y * predictedStepY);
         }
     }
     
+    // Choose how deep and wide to search for the points
+    chooseParameters(bbWidth, bbHeight);
+    stats.level = level;
+    stats.windowSize = windowSize;
+    stats.expectedMotion = motionKnown ? motion : 0;
+    stats.predicted = isPredicted;
+    
     // Calculate optical flow with the iterative Lucas-Kanade method in pyramids
+#ifdef TLD_LEGACY_TRACKER
     // Last parameter flag meanings:
     // CV_LKFLOW_PYR_A_READY: pyramid A is precalculated before the call
     // CV_LKFLOW_PYR_B_READY: pyramid B is precalculated before the call
     // CV_LKFLOW_INITIAL_GUESSES: array B contains initial coordinates of features before the function call
-    cvCalcOpticalFlowPyrLK(prevFrame, nextFrame, prevPyramid, nextPyramid, prevPoints, nextPoints, TOTAL_POINTS, *windowSize, LEVEL, status, 0, *termCriteria, CV_LKFLOW_INITIAL_GUESSES);
-    //cvCalcOpticalFlowPyrLK(nextFrame, prevFrame, nextPyramid, prevPyramid, nextPoints, predPoints, TOTAL_POINTS, *windowSize, LEVEL, predStatus, 0, *termCriteria, CV_LKFLOW_INITIAL_GUESSES | CV_LKFLOW_PYR_A_READY | CV_LKFLOW_PYR_B_READY);
-    
-    
-    // Calculate Bounding-Box Displacement -----------------------------------
-    // Calculate the median displacement of the bounding-box in each dimension
-    // We individually calculate the displacement of each point that was
-    // successfully tracked and then find the median values in each dimension
-    float *dxs = (float *)malloc(TOTAL_POINTS * sizeof(float));
-    float *dys = (float *)malloc(TOTAL_POINTS * sizeof(float));
-    int successful = 0;
-    
-    for (i = 0, x = 0; x < DIM_POINTS; x++) {
-        for (y = 0; y < DIM_POINTS; y++, i++) {
-            if (status[i] == 1) {
-                dxs[successful] = nextPoints[i].x - prevPoints[i].x;
-                dys[successful] = nextPoints[i].y - prevPoints[i].y;
-                successful++;
-            }
-        }
+    // The previous frame's pyramid was built when it was tracked to, and
+    // holds the levels needed if it was built at least as deep. The C API
+    // takes the window half-size
+    int flags = CV_LKFLOW_INITIAL_GUESSES;
+    
+    if (prevPyramidReady && prevPyramidLevel >= level) {
+        flags |= CV_LKFLOW_PYR_A_READY;
     }
     
-    // Get the median displacements
-    double dispX = (double)median(dxs, successful);
-    double dispY = (double)median(dys, successful);
+    cvCalcOpticalFlowPyrLK(prevFrame, nextFrame, prevPyramid, nextPyramid, (CvPoint2D32f *)&prevPoints[0], (CvPoint2D32f *)&nextPoints[0], TOTAL_POINTS, cvSize(windowSize, windowSize), level, (char *)&status[0], 0, termCriteria, flags);
+#else
+    // Both pyramids come from the cache; the previous frame's was built when
+    // it was tracked to, and is only rebuilt if it isn't deep enough.
+    // nextPoints holds the initial guesses
+    calcOpticalFlowPyrLK(pyramids->get(prevFrame, level), pyramids->get(nextFrame, level), prevPoints, nextPoints, status, noArray(), Size(2 * windowSize + 1, 2 * windowSize + 1), level, termCriteria, OPTFLOW_USE_INITIAL_FLOW);
+#endif
     
+    stats.solves = TOTAL_POINTS * (level + 1);
+    stats.trackedPoints = 0;
     
-    // Calculate Bounding-Box Scale Change -----------------------------------
-    // For each possible pair of points we compute the ratio of distance apart
-    // at time t + 1 to distance apart at time t
-    // We then take the median ratio as the scale factor for the bounding-box
-    // First, compute the maximum number of pairs in order to allocate our
-    // ratios array
-    int comparisons = 0;
+    for (i = 0; i < TOTAL_POINTS; i++) {
+        stats.trackedPoints += status[i] == 1;
+    }
     
-    for (i = 1; i < TOTAL_POINTS; i++) {
-        comparisons += i;
+    stats.reliablePoints = stats.trackedPoints;
+    
+    // Filter out the least reliable points
+    if (FORWARD_BACKWARD) {
+        filterPoints(nextFrame);
     }
     
-    // Allocate the ratios array for storing each ratio and reset comparisons
-    // to zero so we can count the number of successful comparisons
-    float *scales = (float *)malloc(comparisons * sizeof(float));
-    //float *scalesX = (float *)malloc(comparisons * sizeof(float));
-    //float *scalesY = (float *)malloc(comparisons * sizeof(float));
-    comparisons = 0;
+    stats.maxIterations = stats.solves * termCriteria.maxCount;
     
-    for (i = 0; i < TOTAL_POINTS; i++) {
-        for (int j = i + 1; j < TOTAL_POINTS; j++) {
-            if (status[i] == 1 && status[j] == 1) {
-                float dxPrev = prevPoints[j].x - prevPoints[i].x;
-                float dyPrev = prevPoints[j].y - prevPoints[i].y;
-                float dxNext = nextPoints[j].x - nextPoints[i].x;
-                float dyNext = nextPoints[j].y - nextPoints[i].y;
-                float sPrev = sqrt(dxPrev * dxPrev + dyPrev * dyPrev);
-                float sNext = sqrt(dxNext * dxNext + dyNext * dyNext);
-                
-                if (sPrev != 0 && sNext != 0) {
-                //if (dxPrev != 0 && dyPrev != 0 && dxNext != 0 && dyNext != 0) {
-                    scales[comparisons] = sNext / sPrev;
-                    //scalesX[comparisons] = dxNext / dxPrev;
-                    //scalesY[comparisons] = dyNext / dyPrev;
-                    comparisons++;
-                }
-            }
+    
+    // Return the previous frame to the pool, keeping the pyramid of the
+    // next for when it is tracked from
+    pool->releaseImage(prevFrame);
+    prevFrame = nextFrame;
+#ifdef TLD_LEGACY_TRACKER
+    IplImage *pyramid = prevPyramid;
+    prevPyramid = nextPyramid;
+    nextPyramid = pyramid;
+    prevPyramidReady = true;
+    prevPyramidLevel = level;
+#endif
+    
+    
+    // Estimate Bounding-Box Motion -----------------------------------------
+    // The bounding-box moves by the median displacement of the successfully
+    // tracked points in each dimension, and scales by the median ratio of
+    // the distances between pairs of them at time t + 1 and time t
+    double dispX, dispY, scale;
+    
+    if (!flow->estimate(&prevPoints[0], &nextPoints[0], &status[0], TOTAL_POINTS, &dispX, &dispY, &scale)) {
+        // No point was tracked, so neither was the bounding-box
+        motionKnown = false;
+        
+        for (i = 0; i < 4; i++) {
+            bbNew[i] = bb[i];
         }
+        
+        bbNew[4] = 0;
+        return;
     }
     
-    // Get the median scale factor
-    double scale = (double)median(scales, comparisons);
-    //double scaleX = (double)median(scalesX, comparisons);
-    //double scaleY = (double)median(scalesY, comparisons);
+    // Expect the object, or the error of its predicted motion, to move as
+    // far next frame, or a little less if it is slowing down
+    double predictedX = isPredicted ? velocityX : 0;
+    double predictedY = isPredicted ? velocityY : 0;
+    double displacement = std::max(fabs(dispX - predictedX), fabs(dispY - predictedY));
+    motion = motionKnown ? std::max(displacement, motion * MOTION_DECAY) : displacement;
+    
+    // Update the velocity, starting afresh after a frame that wasn't
+    // tracked
+    if (motionKnown) {
+        velocityX += VELOCITY_SMOOTHING * (dispX - velocityX);
+        velocityY += VELOCITY_SMOOTHING * (dispY - velocityY);
+        scaleChange += VELOCITY_SMOOTHING * (scale - scaleChange);
+    } else {
+        velocityX = dispX;
+        velocityY = dispY;
+        scaleChange = scale;
+    }
+    
+    motionKnown = true;
     
     // Calculate the offset of the bounidng-box in x and y directions
     // We half the result because the bounding-box is made to expand about its
     // centre
     double offsetX = 0.5f * bbWidth * (scale - 1);
     double offsetY = 0.5f * bbHeight * (scale - 1);
-    //double offsetX = 0.5f * bbWidth * (scaleX - 1);
-    //double offsetY = 0.5f * bbHeight * (scaleY - 1);
-    
-    // Free memory
-    cvReleaseImage(&prevFrame);
-    prevFrame = nextFrame;
-    free(dxs);
-    free(dys);
-    free(scales);
-    //free(scalesX);
-    //free(scalesY);
     
     
     // Set output ------------------------------------------------------------
     // We output the estimated new top-left and bottom-right coordinates of
     // the bounding-box. [top-left x, top-left y, width, height]
-    double *bbNew = new double[5];
     bbNew[0] = bb[0] - offsetX + dispX;
     bbNew[1] = bb[1] - offsetY + dispY;
     bbNew[2] = bb[2] + offsetX * 2;
     bbNew[3] = bb[3] + offsetY * 2;
     bbNew[4] = (double)classifier->classify(nextFrameIntImg, (int)bbNew[0], (int)bbNew[1], (int)bbNew[2], (int)bbNew[3]);
-    
-    return bbNew;
 }
 
 
 void Tracker::setPrevFrame(IplImage *frame) {
-    cvReleaseImage(&prevFrame);
+    pool->releaseImage(prevFrame);
     prevFrame = frame;
+    resetMotion();
+#ifdef TLD_LEGACY_TRACKER
+    prevPyramidReady = false;
+#endif
+}
+
+
+void Tracker::resetMotion() {
+    motion = 0;
+    motionKnown = false;
+    velocityX = 0;
+    velocityY = 0;
+    scaleChange = 1;
+}
+
+
+TrackerStats Tracker::getStats() {
+    return stats;
 }
 
 
 Tracker::~Tracker() {
-    free(prevFrame);
+    // prevFrame belongs to the pool, which frees it
+    delete flow;
+    free(errors);
+    free(sortedErrors);
+#ifdef TLD_LEGACY_TRACKER
     cvReleaseImage(&prevPyramid);
     cvReleaseImage(&nextPyramid);
-    cvFree(&prevPoints);
-    cvFree(&nextPoints);
-    //cvFree(&predPoints);
-    free(windowSize);
-    cvFree(&status);
-    //cvFree(&predStatus);
-    free(termCriteria);
+#endif
 }
@@ -4,11 +4,16 @@
     Foundation. This software is provided without warranty of ANY kind. */
 
 #pragma once
-#include "cv.h"
-#include "highgui.h"
+#include "opencv2/core/core_c.h"
+#include "opencv2/core/core.hpp"
+#include "opencv2/video/tracking.hpp"
 #include "IntegralImage.h"
 #include "Classifier.h"
+#include "FramePool.h"
+#include "MedianFlow.h"
+#include "PyramidCache.h"
 #include <math.h>
+#include <vector>
 
 using namespace cv;
 
@@ -20,13 +25,79 @@ using namespace cv;
 // Total number of points on the bounding-box
 #define TOTAL_POINTS (DIM_POINTS * DIM_POINTS)
 
-// Defines the size of the search window in cvCalcOpticalFlowPyrLK
-#define WINDOW_SIZE 4
+// Bounds of the half-size of the Lucas-Kanade search window, i.e. a window
+// of size s is 2 * s + 1 pixels square
+#define MIN_WINDOW_SIZE 4
+#define MAX_WINDOW_SIZE 10
 
-// Maximal pyramid level number
+// Bounds of the maximal pyramid level number
 // If 0, pyramids are not used (single level); if 1, two levels are used etc.
-#define LEVEL 5
+#define MIN_LEVEL 1
+#define MAX_LEVEL 5
 
+// 1 to choose the pyramid level and window size each frame from the size
+// and recent motion of the bounding-box, 0 to always use MAX_LEVEL and
+// MIN_WINDOW_SIZE
+#define ADAPTIVE_TRACKING 1
+
+// Minimum length in pixels of the shorter side of the bounding-box at the
+// coarsest pyramid level used, so enough of the object is left to track
+#define MIN_LEVEL_BB_SIZE 12
+
+// Multiple of the expected displacement the pyramid level and window size
+// are chosen to be able to follow
+#define MOTION_MARGIN 2
+
+// Factor the expected displacement decays by each frame the object moves
+// less than expected
+#define MOTION_DECAY 0.8
+
+// 1 to predict the motion of the bounding-box with a constant velocity
+// model, starting the Lucas-Kanade search from the predicted positions of
+// the points and letting the detector focus on the predicted bounding-box
+// (see Tracker::predict), 0 to start from where the points were
+#define MOTION_PREDICTION 1
+
+// Weight of each frame's motion in the smoothed velocity and scale change
+#define VELOCITY_SMOOTHING 0.5
+
+// Maximum number of pairs of points the scale change is estimated from;
+// beyond this, pairs are sampled at random (see MedianFlow). 0 always uses
+// every pair
+#define PAIR_SAMPLES 2048
+
+// 1 to estimate the error of each tracked point by tracking it back to the
+// previous frame and filter out the least reliable points (steps 3 and 4
+// below), 0 to use every tracked point
+#define FORWARD_BACKWARD 1
+
+
+
+/*  The parameters and amount of work of a call to Tracker::track. */
+struct TrackerStats {
+    // Maximal pyramid level number and search window half-size used
+    int level;
+    int windowSize;
+    
+    // Displacement in pixels the parameters were chosen to follow, or 0 if
+    // there was no recent motion to go by. With a motion prediction, this
+    // is the expected error of the prediction
+    double expectedMotion;
+    
+    // 1 if the search started from a motion prediction, otherwise 0
+    int predicted;
+    
+    // Number of points tracked successfully, and of those kept by the
+    // forward-backward filter
+    int trackedPoints;
+    int reliablePoints;
+    
+    // Number of Lucas-Kanade solves, i.e. points times pyramid levels times
+    // passes, and the most iterations they could have taken. OpenCV doesn't
+    // report the iterations actually taken
+    int solves;
+    int maxIterations;
+};
 
 
 /*  The Median Flow Tracker.
@@ -41,7 +112,31 @@ using namespace cv;
     5) Set the bounding-box scale and position for the current frame based on
        the median scale and position changes of the remaining points
     
-    This implementation does not implement steps 3 and 4. */
+    The tracking error of each point is its forward-backward error: the
+    distance between the point and where it ends up when tracked forwards to
+    the current frame and back again. Points with an error above the median
+    are filtered out.
+    
+    The pyramid of each frame is built once and shared through the
+    session's PyramidCache, so tracking from a frame reuses the pyramid built
+    when it was tracked to, and tracking backwards reuses both pyramids and
+    costs a single extra Lucas-Kanade solve.
+    
+    Each frame, the pyramid level and search window are chosen to follow the
+    expected displacement (see ADAPTIVE_TRACKING): the recent displacement,
+    decaying while the object slows. If the motion is predicted (see
+    MOTION_PREDICTION), only the error of the prediction needs following, so
+    steadily moving objects, e.g. under a panning camera, are tracked with
+    shallower pyramids. The level is the shallowest that can follow it, no
+    deeper than the bounding-box allows, and the window widens if the
+    bounding-box is too small for a deep enough pyramid. Pyramids are
+    only built as deep as needed, so small, slow objects are tracked cheaply
+    while fast ones aren't lost.
+    
+    By default the tracker uses the cv::Mat optical flow API (OpenCV 2.4 or
+    later). Compiling with TLD_LEGACY_TRACKER uses the C API instead
+    (cvCalcOpticalFlowPyrLK), for older versions of OpenCV; the tracker then
+    keeps its own pyramids, swapping them from frame to frame. */
 class Tracker {
     // Private ===============================================================
     private:
@@ -52,38 +147,82 @@ class Tracker {
     // Previous video stream frame
     IplImage *prevFrame;
     
-    // Buffers for the pyramids used by cvCalcOpticalFlowPyrLK
+#ifdef TLD_LEGACY_TRACKER
+    // Buffers for the pyramids used by cvCalcOpticalFlowPyrLK. They are
+    // swapped after tracking, so the next frame's pyramid becomes the
+    // previous frame's
     IplImage *prevPyramid;
     IplImage *nextPyramid;
     
+    // Whether prevPyramid holds the pyramid of prevFrame, and its level
+    bool prevPyramidReady;
+    int prevPyramidLevel;
+#else
+    // Pyramids of the stream's frames, shared with the session
+    PyramidCache *pyramids;
+#endif
+    
     // The coordinates of the points placed in the bounding-box
     // These points are those that are tracked
     // predPoints = predicted 1st frame points from tracking backwards
-    CvPoint2D32f *prevPoints;
-    CvPoint2D32f *nextPoints;
-    //CvPoint2D32f *predPoints;
+    vector<Point2f> prevPoints;
+    vector<Point2f> nextPoints;
+    vector<Point2f> predPoints;
+    
+    // Maximal pyramid level number and search window half-size of the
+    // current frame
+    int level;
+    int windowSize;
+    
+    // Expected displacement of the bounding-box in pixels, or of its
+    // predicted position with MOTION_PREDICTION, and whether it and the
+    // velocity are known, i.e. the last frame was tracked
+    double motion;
+    bool motionKnown;
+    
+    // Smoothed displacement per frame of the bounding-box centre and change
+    // in its scale
+    double velocityX;
+    double velocityY;
+    double scaleChange;
     
-    // Size of the search window of each pyramid level in cvCalcOpticalFlowPyrLK
-    CvSize *windowSize;
+    // Parameters and work of the last call to track
+    TrackerStats stats;
     
-    // Status output array of cvCalcOpticalFlowPyrLK. Elements are set to 1 if
-    // the flow for the corresponding feature has been found, otherwise 0
+    // Status output array of the Lucas-Kanade method. Elements are set to 1
+    // if the flow for the corresponding feature has been found, otherwise 0
     // status is for forward tracking, predStatus is for backward tracking
-    char *status;
-    //char *predStatus;
+    vector<uchar> status;
+    vector<uchar> predStatus;
     
-    // Specifies the termination criteria of the iterative search algorithm in
-    // cvCalcOpticalFlowPyrLK
-    TermCriteria *termCriteria;
+    // Specifies the termination criteria of the iterative search algorithm
+    TermCriteria termCriteria;
     
     // Pointer to the classifier for the entire program
     Classifier *classifier;
     
-    /*  Returns the median of an array of float values.
-        Note: has side-effect of sorting array A.
-        A: the array
-        length: length of array A */
-    float median(float *A, int length);
+    // Pool the frames we are given came from; prevFrame is released back to
+    // it once it is replaced
+    FramePool *pool;
+    
+    // Estimates the bounding-box motion from the tracked points
+    MedianFlow *flow;
+    
+    // Forward-backward error of each point, and scratch space to find their
+    // median in
+    float *errors;
+    float *sortedErrors;
+    
+    /*  Chooses the pyramid level and window size to track with.
+        bbWidth: width of the bounding-box tracked
+        bbHeight: height of the bounding-box tracked */
+    void chooseParameters(double bbWidth, double bbHeight);
+    
+    /*  Filters out the tracked points least likely to have been tracked
+        correctly, by tracking them back to the previous frame, clearing
+        their status. Reuses both pyramids used by forward tracking.
+        nextFrame: the frame the points were tracked to */
+    void filterPoints(IplImage *nextFrame);
     
     
     // Public ================================================================
@@ -91,23 +230,50 @@ class Tracker {
     /*  Constructor. Initialises the tracker.
         frameWidth: width of the video stream frames
         frameHeight: height of the video stream frames
-        frameSize: size of the video frame as a CvSize object
-        firstFrame: the first video stream frame
-        classifier: pointer to the classifier for the program */
-    Tracker(int frameWidth, int frameHeight, CvSize *frameSize, IplImage *firstFrame, Classifier *classifier);
+        frameSize: size of the video frame as a CvSize object, unused
+            unless TLD_LEGACY_TRACKER
+        firstFrame: the first video stream frame, acquired from pool
+        classifier: pointer to the classifier for the program
+        pool: pool the frames passed to this tracker are acquired from
+        pyramids: cache of the pyramids of the frames from pool, unused if
+            TLD_LEGACY_TRACKER */
+    Tracker(int frameWidth, int frameHeight, CvSize *frameSize, IplImage *firstFrame, Classifier *classifier, FramePool *pool, PyramidCache *pyramids);
     
     /*  Tracks the region of the input frame indicated by the given
         bounding-box.
-        Returns the estimated new bounding box
-            [x, y, width, height, confidence].
-        nextFrame: next video stream frame
+        nextFrame: next video stream frame, acquired from the pool; the
+            tracker keeps it and releases it to the pool when it is replaced
+        nextFrameIntImg: next video stream frame as an IntegralImage
         bb: array containing the trajectory bounding-box
-            [x, y, width, height] */
-    double *track(IplImage *nextFrameIpl, IntegralImage *nextFrame, double *bb);
+            [x, y, width, height]
+        bbNew: array of 5 elements in which to store the estimated new
+            bounding-box [x, y, width, height, confidence] */
+    void track(IplImage *nextFrame, IntegralImage *nextFrameIntImg, double *bb, double *bbNew);
     
-    /*  Setter for prevFrame (also frees the current value of prevFrame). */
+    /*  Predicts where a bounding-box moves to in the next frame, from the
+        velocity of the object over the frames tracked recently.
+        Returns true if the motion was predicted, false if there is no
+        recent motion to go by or MOTION_PREDICTION is 0, in which case the
+        bounding-box is copied unchanged.
+        bb: the bounding-box [x, y, width, height] in the previous frame
+        predicted: array of 4 elements in which to store the predicted
+            bounding-box */
+    bool predict(const double *bb, double *predicted);
+    
+    /*  Returns the parameters and work of the last call to track. */
+    TrackerStats getStats(void);
+    
+    /*  Setter for prevFrame (also releases the current value of prevFrame
+        to the pool). Its pyramid is built when it is next tracked from, if
+        it hasn't been already. Resets the motion (see resetMotion). */
     void setPrevFrame(IplImage *frame);
     
+    /*  Forgets the expected motion and velocity of the bounding-box, so the
+        next frame is tracked as if from a standstill. Call whenever the
+        bounding-box tracked from is replaced other than by tracking, e.g.
+        by a detection, as its motion no longer applies. */
+    void resetMotion(void);
+    
     /*  Destructor. */
     ~Tracker();
 };
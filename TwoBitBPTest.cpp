@@ -6,12 +6,12 @@
 #include "TwoBitBPTest.h"
 
 
-TwoBitBPTest::TwoBitBPTest(float minScale, float maxScale)
-: Feature(minScale, maxScale) {
+TwoBitBPTest::TwoBitBPTest(float minScale, float maxScale, std::mt19937 &random)
+: Feature(minScale, maxScale, random) {
 }
 
 
-int TwoBitBPTest::test(IntegralImage *image, int patchX, int patchY, int patchW, int patchH) {
+int TwoBitBPTest::test(const IntegralImageView &image, int patchX, int patchY, int patchW, int patchH) {
     // Compute the properties of the test rectangles relative to the size and
     // position of the patch
     int x = (int)(xp * (float)patchW) + patchX;
@@ -20,10 +20,10 @@ int TwoBitBPTest::test(IntegralImage *image, int patchX, int patchY, int patchW,
     int h = (int)(hp * (float)patchH * 0.5f);
     
     // Compare the various halfs of the feature on the patch
-    int left = image->sumRect(x, y, w, h * 2);
-    int right = image->sumRect(x + w, y, w, h * 2);
-    int top = image->sumRect(x, y, w * 2, h);
-    int bottom = image->sumRect(x, y + h, w * 2, h);
+    int left = image.sumRectUnchecked(x, y, w, h * 2);
+    int right = image.sumRectUnchecked(x + w, y, w, h * 2);
+    int top = image.sumRectUnchecked(x, y, w * 2, h);
+    int bottom = image.sumRectUnchecked(x, y + h, w * 2, h);
     
     if (left > right) {
         if (top > bottom) {
@@ -46,5 +46,20 @@ int TwoBitBPTest::test(IntegralImage *image, int patchX, int patchY, int patchW,
 }
 
 
+void TwoBitBPTest::getOffsets(int patchW, int patchH, int stride, int *offsets) {
+    // Compute the test rectangle exactly as in test, relative to the patch
+    int x = (int)(xp * (float)patchW);
+    int y = (int)(yp * (float)patchH);
+    int w = (int)(wp * (float)patchW * 0.5f);
+    int h = (int)(hp * (float)patchH * 0.5f);
+    
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            offsets[j * 3 + i] = (y + j * h) * stride + x + i * w;
+        }
+    }
+}
+
+
 TwoBitBPTest::~TwoBitBPTest() {
 }
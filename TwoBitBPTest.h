@@ -6,6 +6,7 @@
 #pragma once
 #include "Feature.h"
 #include "IntegralImage.h"
+#include "Simd.h"
 #include <cstdlib>
 
 
@@ -37,21 +38,80 @@
 class TwoBitBPTest : public Feature {
     // Public ================================================================
     public:
+    // Power of 2 giving the number of possible return values of test, i.e.
+    // 4 (2 ^ 2) possible return values
+    static const int POWER = 2;
+    
+    /*  Constructor. Leaves the feature uninitialised. */
+    TwoBitBPTest(void) {}
+    
     /*  Constructor.
         minScale: minimum percentage of the patch width and height the feature
             can take
         maxScale: maximum percentage of the patch width and height the feature
-            can take */
-    TwoBitBPTest(float minScale, float maxScale);
+            can take
+        random: random number generator to place the feature with */
+    TwoBitBPTest(float minScale, float maxScale, std::mt19937 &random);
     
     /*  Tests the input patch.
         Returns 0-3 depending (see class description).
-        image: image to take patch from
+        The patch must lie within the image and have non-negative
+        dimensions (see Fern::getLeafIndex) as no bounds checking is done.
+        image: view of the image to take patch from
         patchX: patch top-left x-position
         patchX: patch top-left y-position
         patchW: patch width
         patchH: patch height */
-    int test(IntegralImage *image, int patchX, int patchY, int patchW, int patchH);
+    int test(const IntegralImageView &image, int patchX, int patchY, int patchW, int patchH);
+    
+    /*  Computes the integral image offsets of the FEATURE_OFFSETS points
+        describing this feature on a patch of the given size, relative to the
+        patch's top-left element, for use with testOffsets.
+        patchW: patch width
+        patchH: patch height
+        stride: stride of the integral image the patch is in
+        offsets: array of FEATURE_OFFSETS elements to store the offsets in */
+    void getOffsets(int patchW, int patchH, int stride, int *offsets);
+    
+    /*  Tests a patch given the offsets computed by getOffsets for its size.
+        Returns the same value as test would for the patch.
+        patch: pointer to the integral image element at the patch's top-left
+        offsets: offsets computed by getOffsets */
+    static inline int testOffsets(const int *patch, const int *offsets) {
+        // Points are numbered row by row on the 3x3 lattice
+        int left = patch[offsets[0]] + patch[offsets[7]] - patch[offsets[1]] - patch[offsets[6]];
+        int right = patch[offsets[1]] + patch[offsets[8]] - patch[offsets[2]] - patch[offsets[7]];
+        int top = patch[offsets[0]] + patch[offsets[5]] - patch[offsets[2]] - patch[offsets[3]];
+        int bottom = patch[offsets[3]] + patch[offsets[8]] - patch[offsets[5]] - patch[offsets[6]];
+        return (left > right ? 0 : 2) + (top > bottom ? 0 : 1);
+    }
+    
+#ifdef TLD_AVX2
+    /*  Tests 8 patches of the same size at once using AVX2 gathers.
+        Returns the results of testOffsets for each patch.
+        origin: pointer to the integral image element (0, 0)
+        patches: offsets of the patches' top-left elements from origin
+        offsets: offsets computed by getOffsets for the patch size */
+    static inline __m256i testOffsets8(const int *origin, __m256i patches, const int *offsets) {
+        __m256i p[FEATURE_OFFSETS];
+        
+        for (int i = 0; i < FEATURE_OFFSETS; i++) {
+            __m256i index = _mm256_add_epi32(patches, _mm256_set1_epi32(offsets[i]));
+            p[i] = _mm256_i32gather_epi32(origin, index, 4);
+        }
+        
+        __m256i left = _mm256_sub_epi32(_mm256_add_epi32(p[0], p[7]), _mm256_add_epi32(p[1], p[6]));
+        __m256i right = _mm256_sub_epi32(_mm256_add_epi32(p[1], p[8]), _mm256_add_epi32(p[2], p[7]));
+        __m256i top = _mm256_sub_epi32(_mm256_add_epi32(p[0], p[5]), _mm256_add_epi32(p[2], p[3]));
+        __m256i bottom = _mm256_sub_epi32(_mm256_add_epi32(p[3], p[8]), _mm256_add_epi32(p[5], p[6]));
+        
+        // Comparisons give all bits set where true, so masking with 2 and 1
+        // gives the amounts to subtract from 3
+        __m256i leftBrighter = _mm256_and_si256(_mm256_cmpgt_epi32(left, right), _mm256_set1_epi32(2));
+        __m256i topBrighter = _mm256_and_si256(_mm256_cmpgt_epi32(top, bottom), _mm256_set1_epi32(1));
+        return _mm256_sub_epi32(_mm256_set1_epi32(3), _mm256_add_epi32(leftBrighter, topBrighter));
+    }
+#endif
     
     /*  Destructor. */
     ~TwoBitBPTest();
@@ -6,26 +6,63 @@
 % Set typical include and library paths depending on the operating system
 % Update the paths if yours differ
 if ispc
-    include = ' -IC:\OpenCV2.2\include\opencv\ -IC:\OpenCV2.2\include\';
-    libpath = 'C:\OpenCV2.2\lib\';
+    include = ' -IC:\OpenCV2.4\include\';
+    libpath = 'C:\OpenCV2.4\lib\';
     files = dir([libpath '*.lib']);
 elseif ismac
-    include = ' -I/opt/local/include/opencv/ -I/opt/local/include/';
+    include = ' -I/opt/local/include/';
     libpath = '/opt/local/lib/';
     files = dir([libpath 'libopencv*.dylib']);
 elseif isunix
-    include = ' -I/usr/local/include/opencv/ -I/usr/local/include/';
+    include = ' -I/usr/local/include/';
     libpath = '/usr/local/lib/';
     files = dir([libpath 'libopencv*.so*']);
 end
 
+% Compiler and linker flags. The thread pool (see ThreadPool.h) needs
+% C++11, and GCC/Clang need -pthread to compile and link it
+if ispc
+    cxxflags = '';
+    flags = '';
+else
+    cxxflags = ' -std=c++11 -pthread';
+    flags = ' LDFLAGS="$LDFLAGS -pthread"';
+end
+
+% Optional compiler flags. The integral image builder uses SSE2 by default;
+% to enable its AVX2 path, uncomment the line for your compiler
+% cxxflags = [cxxflags ' -mavx2'];    % GCC/Clang
+% cxxflags = [cxxflags ' /arch:AVX2'];    % Visual Studio
+% To count heap allocations per frame (see AllocationCounter.h), add
+% flags = [flags ' -DTLD_COUNT_ALLOCATIONS'];
+% To store the fern posteriors as 8 or 16-bit fixed-point values (see
+% Posterior.h), add
+% flags = [flags ' -DTLD_POSTERIOR_BITS=8'];
+% The tracker uses the cv::Mat optical flow API of OpenCV 2.4 or later. To
+% use the C API of older versions instead (see Tracker.h), add
+% flags = [flags ' -DTLD_LEGACY_TRACKER'];
+
+% Pass the compiler flags on
+if ispc
+    flags = [' COMPFLAGS="$COMPFLAGS' cxxflags '"' flags];
+else
+    flags = [' CXXFLAGS="$CXXFLAGS' cxxflags '"' flags];
+end
+
 % Make a list of all library files
 libs = [];
 for i = 1:length(files)
     libs = [libs ' ' libpath files(i).name];
 end
 
-% Compiles the program
-eval(['mex -O TLD.cpp Classifier.cpp Tracker.cpp Detector.cpp ' ... 
+% Source files of the program other than the mex entry point, which the
+% tests are also built from (see runTests.m)
+sources = ['Classifier.cpp Tracker.cpp Detector.cpp ' ... 
     'IntegralImage.cpp Feature.cpp HaarTest.cpp TwoBitBPTest.cpp ' ... 
-    'Fern.cpp' include libs]);
+    'FramePool.cpp AllocationCounter.cpp ThreadPool.cpp ' ...
+    'ScanningGrid.cpp DetectionSet.cpp DetectionClusters.cpp ' ...
+    'FrameScheduler.cpp FramePipeline.cpp BackgroundLearner.cpp ' ...
+    'TLDSession.cpp TLDEngine.cpp RawVideoFile.cpp MedianFlow.cpp PyramidCache.cpp'];
+
+% Compiles the program
+eval(['mex -O TLD.cpp ' sources flags include libs]);
@@ -0,0 +1,20 @@
+% Copyright 2011 Ben Pryke.
+% This file is part of Ben Pryke's TLD Implementation available under the
+% terms of the GNU General Public License as published by the Free Software
+% Foundation. This software is provided without warranty of ANY kind.
+
+% Compiles the program, then builds and runs each test in the tests
+% directory. Each test is a mex function that stops with an error if a
+% check fails. Tests are built from the same sources, paths and flags as
+% the program (see compile.m), with heap allocations counted (see
+% AllocationCounter.h)
+compile;
+addpath('tests');
+tests = dir(fullfile('tests', 'test*.cpp'));
+
+for i = 1:length(tests)
+    name = tests(i).name(1:end - 4);
+    eval(['mex -O -outdir tests -I. tests/' tests(i).name ' ' sources flags ' -DTLD_COUNT_ALLOCATIONS' include libs]);
+    feval(name);
+    fprintf('%s passed\n', name);
+end
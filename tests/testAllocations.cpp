@@ -0,0 +1,122 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "mex.h"
+#include "AllocationCounter.h"
+#include "TLDSession.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// Globals ==================================================================
+// Constants -----------------------------------------------------------------
+// Size of the synthetic frames
+#define TEST_WIDTH 320
+#define TEST_HEIGHT 240
+
+// Side of the square object moving through the frames
+#define TEST_OBJECT_SIZE 60
+
+// Number of frames processed before allocations are counted, so the pools
+// and caches the session fills lazily have been filled
+#define WARMUP_FRAMES 20
+
+// Number of steady-state frames whose allocations are counted
+#define CHECKED_FRAMES 100
+
+
+
+/// Methods ==================================================================
+/*  Draws a frame of a synthetic sequence: a checkerboard square moving
+    smoothly over a noisy background.
+    pixels: row-major frame to draw in
+    background: row-major background
+    t: index of the frame
+    bb: set to the bounding-box of the square [x, y, width, height] */
+static void drawFrame(uint8_t *pixels, const uint8_t *background, int t, double *bb) {
+    int objectX = 100 + (int)(30 * sin(t * 0.05));
+    int objectY = 80 + (int)(20 * cos(t * 0.05));
+    
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+        for (int x = 0; x < TEST_WIDTH; x++) {
+            int u = x - objectX;
+            int v = y - objectY;
+            bool inside = u >= 0 && u < TEST_OBJECT_SIZE && v >= 0 && v < TEST_OBJECT_SIZE;
+            pixels[y * TEST_WIDTH + x] = inside ? ((u / 10 + v / 10) % 2 ? 230 : 20) : background[y * TEST_WIDTH + x];
+        }
+    }
+    
+    bb[0] = objectX;
+    bb[1] = objectY;
+    bb[2] = TEST_OBJECT_SIZE;
+    bb[3] = TEST_OBJECT_SIZE;
+}
+
+
+/*  Checks that a session makes no heap allocations processing frames once
+    warmed up, including in the background learner, with the tracker
+    running on every frame checked. Needs TLD_COUNT_ALLOCATIONS (see
+    AllocationCounter.h), which runTests.m defines.
+    Call form: testAllocations() */
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+#ifndef TLD_COUNT_ALLOCATIONS
+    mexErrMsgTxt("testAllocations MUST be built with TLD_COUNT_ALLOCATIONS");
+#else
+    uint8_t *background = (uint8_t *)malloc(TEST_WIDTH * TEST_HEIGHT);
+    uint8_t *pixels = (uint8_t *)malloc(TEST_WIDTH * TEST_HEIGHT);
+    double bb[4];
+    srand(1);
+    
+    for (int i = 0; i < TEST_WIDTH * TEST_HEIGHT; i++) {
+        background[i] = (uint8_t)(100 + rand() % 40);
+    }
+    
+    drawFrame(pixels, background, 0, bb);
+    TLDSession *session = new TLDSession(TEST_WIDTH, TEST_HEIGHT, DETECTOR_THREADS, true);
+    bool ok = session->init(pixels, 1, TEST_WIDTH, bb);
+    
+    // Warm up, then count the allocations of the steady-state frames and
+    // how many of them were tracked
+    unsigned long allocations = 0;
+    int tracked = 0;
+    
+    for (int t = 1; ok && t <= WARMUP_FRAMES + CHECKED_FRAMES; t++) {
+        drawFrame(pixels, background, t, bb);
+        unsigned long before = getAllocationCount();
+        TLDResult result = session->process(pixels, 1, TEST_WIDTH);
+        
+        // Count the background learner's training on the frame too
+        session->flushLearning();
+        
+        if (t > WARMUP_FRAMES) {
+            allocations += getAllocationCount() - before;
+            tracked += result.trackerStats.trackedPoints > 0;
+        }
+    }
+    
+    delete session;
+    free(background);
+    free(pixels);
+    
+    // Report any failure once everything is freed, as the error doesn't
+    // return
+    char message[128];
+    
+    if (!ok) {
+        mexErrMsgTxt("testAllocations: the session couldn't be initialised");
+    }
+    
+    if (allocations != 0) {
+        sprintf(message, "testAllocations: %lu allocations in %d steady-state frames", allocations, CHECKED_FRAMES);
+        mexErrMsgTxt(message);
+    }
+    
+    if (tracked != CHECKED_FRAMES) {
+        sprintf(message, "testAllocations: only %d of %d steady-state frames were tracked", tracked, CHECKED_FRAMES);
+        mexErrMsgTxt(message);
+    }
+#endif
+}
@@ -0,0 +1,249 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "mex.h"
+#include "DetectionClusters.h"
+#include "DetectionSet.h"
+#include "Detector.h"
+#include "TLDSession.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// Globals ==================================================================
+// Constants -----------------------------------------------------------------
+// Size of the frames the detections were found in
+#define TEST_WIDTH 320
+#define TEST_HEIGHT 240
+
+// Detections [x, y, width, height, confidence, overlapping] recorded before
+// clustering in two frames of a 320x240 sequence
+static const double recordedA[][6] = {
+    {81, 96, 54, 54, 0, 1},
+    {81, 102, 54, 54, 0.0555555597, 1},
+    {90, 90, 54, 54, 0.0555555597, 1},
+    {90, 96, 54, 54, 0.0714285746, 1},
+    {90, 102, 54, 54, 0.265833318, 1},
+    {90, 108, 54, 54, 0, 1},
+    {99, 96, 54, 54, 0.0142857153, 1},
+    {99, 102, 54, 54, 0.0199999996, 1},
+    {99, 108, 54, 54, 0.0916666687, 1},
+    {72, 84, 66, 66, 0.594688654, 0},
+    {72, 96, 66, 66, 0.0250000004, 1},
+    {80, 84, 66, 66, 0.0449999981, 1},
+    {80, 90, 66, 66, 0.0644444451, 1},
+    {80, 96, 66, 66, 0.0250000004, 1},
+    {80, 102, 66, 66, 0, 1},
+    {88, 84, 66, 66, 0, 1},
+    {88, 90, 66, 66, 0.215000004, 1},
+    {88, 96, 66, 66, 0.319999993, 1},
+    {88, 102, 66, 66, 0.150000006, 1},
+    {88, 108, 66, 66, 0, 1},
+    {96, 90, 66, 66, 0, 1},
+    {96, 96, 66, 66, 0, 1}
+};
+
+static const double recordedB[][6] = {
+    {81, 96, 54, 54, 0, 1},
+    {81, 102, 54, 54, 0.0555555597, 1},
+    {90, 90, 54, 54, 0.0555555597, 1},
+    {90, 96, 54, 54, 0.0714285746, 1},
+    {90, 102, 54, 54, 0.265833318, 1},
+    {90, 108, 54, 54, 0, 1},
+    {99, 96, 54, 54, 0.0142857153, 1},
+    {99, 102, 54, 54, 0.0199999996, 1},
+    {99, 108, 54, 54, 0.0916666687, 1},
+    {72, 84, 66, 66, 0.594688654, 0},
+    {72, 96, 66, 66, 0.0250000004, 1},
+    {80, 84, 66, 66, 0.0449999981, 1},
+    {80, 90, 66, 66, 0.0644444451, 1},
+    {80, 96, 66, 66, 0.0250000004, 1},
+    {80, 102, 66, 66, 0, 1},
+    {88, 84, 66, 66, 0, 1},
+    {88, 90, 66, 66, 0.215000004, 1},
+    {88, 96, 66, 66, 0.319999993, 1},
+    {88, 102, 66, 66, 0.150000006, 1},
+    {88, 108, 66, 66, 0, 1},
+    {96, 90, 66, 66, 0, 1},
+    {96, 96, 66, 66, 0, 1}
+};
+
+
+
+/// Methods ==================================================================
+/*  Fills a set with detections.
+    set: the set
+    rows: detections [x, y, width, height, confidence, overlapping]
+    n: number of detections */
+static void fill(DetectionSet *set, const double (*rows)[6], int n) {
+    set->clear();
+    
+    for (int i = 0; i < n; i++) {
+        set->set(i, rows[i], rows[i][4], rows[i][5]);
+    }
+    
+    set->append(0, n);
+}
+
+
+/*  Fills a set with a window at every position and scale of a dense
+    scanning grid, with random confidences drawn from a few values, so many
+    tie, and random overlapping flags.
+    set: the set */
+static void fillDense(DetectionSet *set) {
+    set->clear();
+    int n = 0;
+    
+    for (int scale = 0; scale < 3; scale++) {
+        int size = 40 + scale * 12;
+        
+        for (int x = 0; x + size <= TEST_WIDTH; x += 7) {
+            for (int y = 0; y + size <= TEST_HEIGHT; y += 7) {
+                double bb[4] = {(double)x, (double)y, (double)size, (double)size};
+                set->set(n++, bb, (rand() % 16) / 15.0, rand() % 4 == 0);
+            }
+        }
+    }
+    
+    set->append(0, n);
+}
+
+
+/*  Clusters detections by comparing each with the representative of every
+    cluster so far, as DetectionClusters would without its grid.
+    Returns the number of clusters.
+    set: the detections
+    minOverlap: minimum overlap to join a cluster
+    representatives: set to the representative of each cluster
+    memberCounts: set to the number of members of each cluster
+    clusterOf: set to the cluster of each detection */
+static int bruteForce(DetectionSet *set, double minOverlap, int *representatives, int *memberCounts, int *clusterOf) {
+    int n = set->size();
+    double *confidences = set->getConfidences();
+    double *overlaps = set->getOverlaps();
+    int *order = new int[n];
+    int count = 0;
+    
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    
+    // Decreasing confidence, then increasing index
+    for (int i = 1; i < n; i++) {
+        int d = order[i];
+        int j = i;
+        
+        while (j > 0 && confidences[order[j - 1]] < confidences[d]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        
+        order[j] = d;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        int d = order[i];
+        double bb[4] = {set->getXs()[d], set->getYs()[d], set->getWidths()[d], set->getHeights()[d]};
+        int best = -1;
+        
+        // The first overlapping cluster is the most confident one
+        for (int c = 0; c < count && best == -1; c++) {
+            int r = representatives[c];
+            double rbb[4] = {set->getXs()[r], set->getYs()[r], set->getWidths()[r], set->getHeights()[r]};
+            
+            if (overlaps[r] == overlaps[d] && Detector::bbOverlap(bb, rbb) > minOverlap) {
+                best = c;
+            }
+        }
+        
+        if (best == -1) {
+            best = count++;
+            representatives[best] = d;
+            memberCounts[best] = 0;
+        }
+        
+        memberCounts[best]++;
+        clusterOf[d] = best;
+    }
+    
+    delete [] order;
+    return count;
+}
+
+
+/*  Clusters a set with DetectionClusters and by brute force, and compares
+    the clusters.
+    Returns the number of differences, and sets message on the first.
+    set: the detections
+    name: name of the set in messages
+    message: buffer for a message describing the first difference */
+static int compare(DetectionSet *set, const char *name, char *message) {
+    int n = set->size();
+    int *representatives = new int[n];
+    int *memberCounts = new int[n];
+    int *clusterOf = new int[n];
+    DetectionClusters *clusters = new DetectionClusters(TEST_WIDTH, TEST_HEIGHT, MAX_WINDOWS);
+    int differences = 0;
+    
+    clusters->cluster(set, MIN_CLUSTER_OVERLAP);
+    int count = bruteForce(set, MIN_CLUSTER_OVERLAP, representatives, memberCounts, clusterOf);
+    
+    if (clusters->size() != count) {
+        sprintf(message, "testClusters: %s: %d clusters, %d by brute force", name, clusters->size(), count);
+        differences++;
+    }
+    
+    for (int c = 0; c < count && differences == 0; c++) {
+        if (clusters->getRepresentative(c) != representatives[c] || clusters->getMemberCount(c) != memberCounts[c]) {
+            sprintf(message, "testClusters: %s: cluster %d differs from brute force", name, c);
+            differences++;
+        }
+    }
+    
+    for (int i = 0; i < n && differences == 0; i++) {
+        if (clusters->getCluster(i) != clusterOf[i]) {
+            sprintf(message, "testClusters: %s: detection %d is in cluster %d, %d by brute force", name, i, clusters->getCluster(i), clusterOf[i]);
+            differences++;
+        }
+    }
+    
+    delete clusters;
+    delete [] representatives;
+    delete [] memberCounts;
+    delete [] clusterOf;
+    return differences;
+}
+
+
+/*  Checks that DetectionClusters, which finds overlapping detections through
+    a grid, gives exactly the clusters of comparing every detection with
+    every cluster, on recorded detection sets and a dense synthetic one.
+    Call form: testClusters() */
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    DetectionSet *set = new DetectionSet(MAX_WINDOWS, 1);
+    char message[160];
+    int differences = 0;
+    srand(1);
+    
+    fill(set, recordedA, sizeof(recordedA) / sizeof(recordedA[0]));
+    differences += compare(set, "recorded set A", message);
+    
+    if (differences == 0) {
+        fill(set, recordedB, sizeof(recordedB) / sizeof(recordedB[0]));
+        differences += compare(set, "recorded set B", message);
+    }
+    
+    if (differences == 0) {
+        fillDense(set);
+        differences += compare(set, "dense set", message);
+    }
+    
+    delete set;
+    
+    if (differences > 0) {
+        mexErrMsgTxt(message);
+    }
+}
@@ -0,0 +1,171 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "mex.h"
+#include "Classifier.h"
+#include "Fern.h"
+#include "IntegralImage.h"
+#include "TwoBitBPTest.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// Globals ==================================================================
+// Constants -----------------------------------------------------------------
+// Size of the test frame
+#define TEST_WIDTH 320
+#define TEST_HEIGHT 240
+
+// Number of nodes of the ferns tested
+#define TEST_NODES 5
+
+// Number of ferns tested
+#define TEST_FERNS 10
+
+// Number of positions of the patches of each size in each dimension, the
+// last at the right or bottom edge of the frame. Not a multiple of 8, so
+// the scalar remainder of a batch is exercised too
+#define TEST_POSITIONS 13
+
+// Patch sizes tested, the last filling the frame
+static const int testSizes[][2] = {{24, 24}, {41, 67}, {120, 90}, {200, 170}, {TEST_WIDTH, TEST_HEIGHT}};
+
+
+
+/// Methods ==================================================================
+/*  Lays out patches of a size over the frame, from the top-left corner to
+    the bottom-right one.
+    Returns the number of patches.
+    w: patch width
+    h: patch height
+    stride: stride of the frame's integral image
+    xs: set to the patches' top-left x-positions
+    ys: set to the patches' top-left y-positions
+    windows: set to the patches' top-left offsets, y * stride + x */
+static int layoutPatches(int w, int h, int stride, int *xs, int *ys, int *windows) {
+    int count = 0;
+    
+    for (int i = 0; i < TEST_POSITIONS; i++) {
+        for (int j = 0; j < TEST_POSITIONS; j++) {
+            xs[count] = (TEST_WIDTH - w) * i / (TEST_POSITIONS - 1);
+            ys[count] = (TEST_HEIGHT - h) * j / (TEST_POSITIONS - 1);
+            windows[count] = ys[count] * stride + xs[count];
+            count++;
+        }
+    }
+    
+    return count;
+}
+
+
+/*  Checks that the leaf node indices computed for a batch of patches (see
+    Fern::getLeafIndices), with AVX2 gathers when compiled with TLD_AVX2,
+    are bit-exact with those computed patch by patch from the image, for
+    patches all over a frame including its right and bottom edges. Also
+    checks that Classifier::classifyBatch gives the same posteriors as
+    Classifier::classify.
+    Call form: testLeafIndices() */
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    const int patchCount = TEST_POSITIONS * TEST_POSITIONS;
+    const int leafCount = Fern<TEST_NODES, TwoBitBPTest>::LEAVES;
+    uint8_t *pixels = (uint8_t *)malloc(TEST_WIDTH * TEST_HEIGHT);
+    srand(1);
+    
+    for (int i = 0; i < TEST_WIDTH * TEST_HEIGHT; i++) {
+        pixels[i] = (uint8_t)(rand() % 256);
+    }
+    
+    IntegralImage *frame = new IntegralImage();
+    frame->createFromBuffer(pixels, TEST_WIDTH, TEST_HEIGHT, TEST_WIDTH);
+    int stride = frame->getStride();
+    const int *origin = frame->view().getOrigin();
+    
+    // Ferns with random features, and a classifier
+    Fern<TEST_NODES, TwoBitBPTest> *ferns = new Fern<TEST_NODES, TwoBitBPTest>[TEST_FERNS];
+    int *counts = new int[TEST_FERNS * leafCount * 2];
+    Posterior *posteriors = new Posterior[TEST_FERNS * leafCount];
+    std::mt19937 random(1);
+    
+    for (int i = 0; i < TEST_FERNS; i++) {
+        ferns[i].init(0.1f, 0.5f, random, counts + i * leafCount * 2, posteriors + i * leafCount);
+    }
+    
+    Classifier *classifier = Classifier::create(TEST_FERNS, TEST_NODES, FEATURE_TWO_BIT_BP, 0.1f, 0.5f, random);
+    
+    // Train the classifier on some patches, so posteriors differ
+    for (int i = 0; i < 200; i++) {
+        classifier->train(frame, rand() % (TEST_WIDTH - 40), rand() % (TEST_HEIGHT - 40), 40, 40, i % 3 == 0);
+    }
+    
+    classifier->publish();
+    
+    int *xs = new int[patchCount];
+    int *ys = new int[patchCount];
+    int *windows = new int[patchCount];
+    int *leaves = new int[patchCount];
+    int *offsets = new int[classifier->getOffsetCount()];
+    float *confidences = new float[patchCount];
+    int mismatches = 0;
+    int posteriorMismatches = 0;
+    char message[160];
+    message[0] = 0;
+    
+    for (int s = 0; s < (int)(sizeof(testSizes) / sizeof(testSizes[0])); s++) {
+        int w = testSizes[s][0];
+        int h = testSizes[s][1];
+        int count = layoutPatches(w, h, stride, xs, ys, windows);
+        
+        // Compare each fern's batch indices with its per-patch indices
+        for (int f = 0; f < TEST_FERNS; f++) {
+            int fernOffsets[Fern<TEST_NODES, TwoBitBPTest>::OFFSETS];
+            ferns[f].getOffsets(w, h, stride, fernOffsets);
+            ferns[f].getLeafIndices(origin, windows, count, fernOffsets, leaves);
+            
+            for (int i = 0; i < count; i++) {
+                int expected = ferns[f].getLeafIndex(frame, xs[i], ys[i], w, h);
+                
+                if (leaves[i] != expected && mismatches++ == 0) {
+                    sprintf(message, "testLeafIndices: fern %d, %dx%d patch at (%d, %d): batch index %d, per-patch index %d", f, w, h, xs[i], ys[i], leaves[i], expected);
+                }
+            }
+        }
+        
+        // Compare the classifier's batch posteriors with its per-patch ones
+        classifier->getOffsets(w, h, stride, offsets);
+        classifier->classifyBatch(frame, windows, count, offsets, -1.0f, confidences, NULL);
+        
+        for (int i = 0; i < count; i++) {
+            posteriorMismatches += confidences[i] != classifier->classify(frame, xs[i], ys[i], w, h);
+        }
+    }
+    
+#ifdef TLD_AVX2
+    mexPrintf("testLeafIndices: compared the AVX2 batch path with the per-patch path\n");
+#else
+    mexPrintf("testLeafIndices: TLD_AVX2 not defined, compared the scalar batch path with the per-patch path\n");
+#endif
+    
+    delete classifier;
+    delete [] ferns;
+    delete [] counts;
+    delete [] posteriors;
+    delete [] xs;
+    delete [] ys;
+    delete [] windows;
+    delete [] leaves;
+    delete [] offsets;
+    delete [] confidences;
+    delete frame;
+    free(pixels);
+    
+    if (mismatches > 0) {
+        mexErrMsgTxt(message);
+    }
+    
+    if (posteriorMismatches > 0) {
+        sprintf(message, "testLeafIndices: %d batch posteriors differ from the per-patch ones", posteriorMismatches);
+        mexErrMsgTxt(message);
+    }
+}
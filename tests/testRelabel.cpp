@@ -0,0 +1,153 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "mex.h"
+#include "Classifier.h"
+#include "Detector.h"
+#include "IntegralImage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/// Globals ==================================================================
+// Constants -----------------------------------------------------------------
+// Size of the test frame
+#define TEST_WIDTH 320
+#define TEST_HEIGHT 240
+
+// Minimum variance of the variance filter rejecting every window of the
+// test frame
+#define TEST_HIGH_VARIANCE 1e9
+
+// Tracked bounding-box, and a prediction of it that is a whole width out,
+// so no window overlaps both by enough to be kept
+static double testTbb[4] = {100, 80, 60, 60};
+static double testPredicted[4] = {160, 80, 60, 60};
+
+
+
+/// Methods ==================================================================
+/*  Finds a detection with the given bounding-box in a set.
+    Returns its index, or -1 if there is none.
+    detections: the set
+    bb: bounding-box [x, y, width, height] */
+static int find(DetectionSet *detections, const double *bb) {
+    for (int i = 0; i < detections->size(); i++) {
+        if (detections->getXs()[i] == bb[0] && detections->getYs()[i] == bb[1] && detections->getWidths()[i] == bb[2] && detections->getHeights()[i] == bb[3]) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+
+/*  Detects with a mispredicted bounding-box and relabels with the tracked
+    one, and compares the detections with those of detecting with the
+    tracked bounding-box in the first place.
+    Returns the number of differences, and sets message on the first.
+    frame: frame to detect in
+    classifier: classifier to detect with
+    minVariance: minimum variance of the variance filter
+    focus: whether the detector focuses on the mispredicted bounding-box
+    name: name of the case in messages
+    message: buffer for a message describing the first difference */
+static int compare(IntegralImage *frame, Classifier *classifier, double minVariance, bool focus, const char *name, char *message) {
+    int fernCount = classifier->getFernCount();
+    Detector *expected = new Detector(TEST_WIDTH, TEST_HEIGHT, testTbb, classifier, NULL, minVariance);
+    Detector *relabelled = new Detector(TEST_WIDTH, TEST_HEIGHT, testTbb, classifier, NULL, minVariance);
+    DetectionSet *expectedSet = new DetectionSet(MAX_WINDOWS, fernCount);
+    DetectionSet *relabelledSet = new DetectionSet(MAX_WINDOWS, fernCount);
+    int differences = 0;
+    
+    expected->detect(frame, testTbb, expectedSet, false, false);
+    relabelled->detect(frame, testPredicted, relabelledSet, focus, true);
+    relabelled->relabel(relabelledSet, testTbb);
+    DetectorStats stats = relabelled->getStats();
+    
+    if (expectedSet->size() == 0) {
+        sprintf(message, "testRelabel: %s: no window overlaps the tracked bounding-box", name);
+        differences++;
+    }
+    
+    if (differences == 0 && relabelledSet->size() != expectedSet->size()) {
+        sprintf(message, "testRelabel: %s: %d detections after relabelling, %d expected", name, relabelledSet->size(), expectedSet->size());
+        differences++;
+    }
+    
+    // Every detection expected is found with the same confidence, label and
+    // leaf codes
+    for (int i = 0; i < expectedSet->size() && differences == 0; i++) {
+        double bb[4] = {expectedSet->getXs()[i], expectedSet->getYs()[i], expectedSet->getWidths()[i], expectedSet->getHeights()[i]};
+        int j = find(relabelledSet, bb);
+        
+        if (j == -1 || relabelledSet->getConfidences()[j] != expectedSet->getConfidences()[i] || relabelledSet->getOverlaps()[j] != expectedSet->getOverlaps()[i] || memcmp(relabelledSet->getCodes(j), expectedSet->getCodes(i), fernCount * sizeof(int)) != 0) {
+            sprintf(message, "testRelabel: %s: detection [%g, %g, %g, %g] lost or changed by relabelling", name, bb[0], bb[1], bb[2], bb[3]);
+            differences++;
+        }
+    }
+    
+    // Every window is still counted by exactly one stage
+    if (differences == 0 && (stats.accepted != relabelledSet->size() || stats.skipped + stats.varianceRejected + stats.classifierRejected + stats.accepted != stats.windows)) {
+        sprintf(message, "testRelabel: %s: stage counts don't add up after relabelling", name);
+        differences++;
+    }
+    
+    delete expectedSet;
+    delete relabelledSet;
+    delete expected;
+    delete relabelled;
+    return differences;
+}
+
+
+/*  Checks that relabelling the detections of a scan around a wrongly
+    predicted bounding-box (see Detector::relabel) keeps every window
+    overlapping the tracked bounding-box, as a scan around the tracked
+    bounding-box would, whether the scan skipped those windows, rejected
+    them by variance or rejected them by classifier.
+    Call form: testRelabel() */
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    uint8_t *pixels = (uint8_t *)malloc(TEST_WIDTH * TEST_HEIGHT);
+    char message[160];
+    int differences = 0;
+    srand(1);
+    
+    for (int i = 0; i < TEST_WIDTH * TEST_HEIGHT; i++) {
+        pixels[i] = (uint8_t)(rand() % 256);
+    }
+    
+    IntegralImage *frame = new IntegralImage();
+    frame->setBuildSquares(true);
+    frame->createFromBuffer(pixels, TEST_WIDTH, TEST_HEIGHT, TEST_WIDTH);
+    std::mt19937 random(1);
+    Classifier *classifier = Classifier::create(10, 5, FEATURE_TWO_BIT_BP, 0.1f, 0.5f, random);
+    
+    // Train the classifier on some patches, so confidences differ
+    for (int i = 0; i < 200; i++) {
+        classifier->train(frame, rand() % (TEST_WIDTH - 40), rand() % (TEST_HEIGHT - 40), 40, 40, i % 3 == 0);
+    }
+    
+    classifier->publish();
+    
+    differences += compare(frame, classifier, 0, false, "classifier rejected", message);
+    
+    if (differences == 0) {
+        differences += compare(frame, classifier, TEST_HIGH_VARIANCE, false, "variance rejected", message);
+    }
+    
+    if (differences == 0) {
+        differences += compare(frame, classifier, 0, true, "skipped", message);
+    }
+    
+    delete classifier;
+    delete frame;
+    free(pixels);
+    
+    if (differences > 0) {
+        mexErrMsgTxt(message);
+    }
+}
@@ -0,0 +1,92 @@
+/*  Copyright 2011 Ben Pryke.
+    This file is part of Ben Pryke's TLD Implementation available under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation. This software is provided without warranty of ANY kind. */
+
+#include "mex.h"
+#include "Classifier.h"
+#include "Detector.h"
+#include "IntegralImage.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// Globals ==================================================================
+// Constants -----------------------------------------------------------------
+// Size of the test frame
+#define TEST_WIDTH 320
+#define TEST_HEIGHT 240
+
+// Bounding-box so large that the largest scanned windows are larger than
+// the frame (see SCAN_MAX_SCALE)
+static double testBB[4] = {0, 0, 250, 200};
+
+
+
+/// Methods ==================================================================
+/*  Scans a frame with a detector whose variance filter has the given
+    minimum.
+    Returns the detector's stage counts.
+    pixels: row-major frame
+    minVariance: minimum variance of a window */
+static DetectorStats scan(const uint8_t *pixels, double minVariance) {
+    IntegralImage *frame = new IntegralImage();
+    frame->setBuildSquares(true);
+    frame->createFromBuffer(pixels, TEST_WIDTH, TEST_HEIGHT, TEST_WIDTH);
+    std::mt19937 random(1);
+    Classifier *classifier = Classifier::create(10, 5, FEATURE_TWO_BIT_BP, 0.1f, 0.5f, random);
+    Detector *detector = new Detector(TEST_WIDTH, TEST_HEIGHT, testBB, classifier, NULL, minVariance);
+    DetectionSet *detections = new DetectionSet(MAX_WINDOWS, classifier->getFernCount());
+    
+    detector->detect(frame, NULL, detections, false, false);
+    DetectorStats stats = detector->getStats();
+    
+    delete detections;
+    delete detector;
+    delete classifier;
+    delete frame;
+    return stats;
+}
+
+
+/*  Checks that the variance filter measures windows larger than the frame
+    over the part of them inside it, as their features are, rather than
+    reading past the frame's squared-sum table: on a flat frame every window
+    is rejected, and on a noisy frame none is. Run under AddressSanitizer to
+    also catch any read out of bounds.
+    Call form: testVarianceFilter() */
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    uint8_t *pixels = (uint8_t *)malloc(TEST_WIDTH * TEST_HEIGHT);
+    char message[128];
+    srand(1);
+    
+    // A flat frame has no variance at all
+    for (int i = 0; i < TEST_WIDTH * TEST_HEIGHT; i++) {
+        pixels[i] = 128;
+    }
+    
+    DetectorStats flat = scan(pixels, 1);
+    
+    // Every window of a frame of uniform noise has about the same variance,
+    // 1365 for intensities uniform over 0 to 127
+    for (int i = 0; i < TEST_WIDTH * TEST_HEIGHT; i++) {
+        pixels[i] = (uint8_t)(rand() % 128);
+    }
+    
+    DetectorStats noisy = scan(pixels, 1000);
+    free(pixels);
+    
+    if (flat.windows == 0 || noisy.windows == 0) {
+        mexErrMsgTxt("testVarianceFilter: no windows were scanned");
+    }
+    
+    if (flat.varianceRejected != flat.windows) {
+        sprintf(message, "testVarianceFilter: %d of %d windows of a flat frame passed", flat.windows - flat.varianceRejected, flat.windows);
+        mexErrMsgTxt(message);
+    }
+    
+    if (noisy.varianceRejected != 0) {
+        sprintf(message, "testVarianceFilter: %d of %d windows of a noisy frame were rejected", noisy.varianceRejected, noisy.windows);
+        mexErrMsgTxt(message);
+    }
+}